@@ -90,18 +90,50 @@ LINK32=link.exe
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\src\allocator.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\arena.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\article.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\compress.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\config.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\epoch.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\fileutils.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\pagecache.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\pool.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\shmcache.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sync.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\template.c
 # End Source File
 # Begin Source File
@@ -118,10 +150,22 @@ SOURCE=.\src\windowshelper.c
 # PROP Default_Filter "h;hpp;hxx;hm;inl"
 # Begin Source File
 
+SOURCE=.\src\allocator.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\arena.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\article.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\compress.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\config.h
 # End Source File
 # Begin Source File
@@ -130,10 +174,30 @@ SOURCE=.\src\constants.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\epoch.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\fileutils.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\pagecache.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\pool.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\shmcache.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sync.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\template.h
 # End Source File
 # Begin Source File
@@ -178,7 +178,7 @@ void print_page(const char *page_path) {
 
 	// Print the page content and free it.
 	printf("%s\n", content);
-	free(content);
+	uki_free(content);
 }
 
 /**
@@ -198,7 +198,7 @@ void print_article(const size_t index) {
 	}
 
 	printf("%s\n", content);
-	free(content);
+	uki_free(content);
 }
 
 /**
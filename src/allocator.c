@@ -0,0 +1,108 @@
+/**
+ * allocator.c
+ * Memory allocation hooks used throughout the library.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#include "allocator.h"
+#include <string.h>
+
+// Private methods.
+void* std_malloc(void *ctx, size_t size);
+void* std_realloc(void *ctx, void *ptr, size_t size);
+void std_free(void *ctx, void *ptr);
+
+// Allocator currently in use.
+static uki_allocator_t allocator = { std_malloc, std_realloc, std_free, NULL };
+
+/**
+ * Sets the allocator used for every bit of memory the library allocates.
+ * @remark This should be done before anything gets allocated, since memory
+ *         must always be freed by the same allocator that allocated it.
+ *
+ * @param custom Allocator to be used or NULL to go back to the standard one.
+ */
+void set_allocator(const uki_allocator_t *custom) {
+	if (custom == NULL) {
+		allocator.malloc = std_malloc;
+		allocator.realloc = std_realloc;
+		allocator.free = std_free;
+		allocator.ctx = NULL;
+
+		return;
+	}
+
+	allocator = *custom;
+}
+
+/**
+ * Allocates a block of memory.
+ *
+ * @param  size Size of the block.
+ * @return      Allocated block or NULL if the allocation failed.
+ */
+void* mem_malloc(const size_t size) {
+	return allocator.malloc(allocator.ctx, size);
+}
+
+/**
+ * Allocates a zeroed array.
+ *
+ * @param  count Number of elements in the array.
+ * @param  size  Size of each element.
+ * @return       Allocated array or NULL if the allocation failed.
+ */
+void* mem_calloc(const size_t count, const size_t size) {
+	void *ptr;
+
+	if ((ptr = mem_malloc(count * size)) != NULL)
+		memset(ptr, 0, count * size);
+
+	return ptr;
+}
+
+/**
+ * Resizes a block of memory.
+ *
+ * @param  ptr  Block to be resized or NULL to allocate a new one.
+ * @param  size New size of the block.
+ * @return      Resized block or NULL if the allocation failed.
+ */
+void* mem_realloc(void *ptr, const size_t size) {
+	return allocator.realloc(allocator.ctx, ptr, size);
+}
+
+/**
+ * Frees a block of memory.
+ *
+ * @param ptr Block to be freed. (Can be NULL)
+ */
+void mem_free(void *ptr) {
+	if (ptr != NULL)
+		allocator.free(allocator.ctx, ptr);
+}
+
+/**
+ * Standard library malloc wrapper.
+ */
+void* std_malloc(void *ctx, size_t size) {
+	(void)ctx;
+	return malloc(size);
+}
+
+/**
+ * Standard library realloc wrapper.
+ */
+void* std_realloc(void *ctx, void *ptr, size_t size) {
+	(void)ctx;
+	return realloc(ptr, size);
+}
+
+/**
+ * Standard library free wrapper.
+ */
+void std_free(void *ctx, void *ptr) {
+	(void)ctx;
+	free(ptr);
+}
@@ -0,0 +1,31 @@
+/**
+ * allocator.h
+ * Memory allocation hooks used throughout the library.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#ifndef _ALLOCATOR_H_
+#define _ALLOCATOR_H_
+
+#include "windowshelper.h"
+#include <stdlib.h>
+
+// Memory allocator structure.
+typedef struct {
+	void* (*malloc)(void *ctx, size_t size);
+	void* (*realloc)(void *ctx, void *ptr, size_t size);
+	void  (*free)(void *ctx, void *ptr);
+	void *ctx;
+} uki_allocator_t;
+
+// Allocator setup.
+void set_allocator(const uki_allocator_t *allocator);
+
+// Allocation.
+void* mem_malloc(const size_t size);
+void* mem_calloc(const size_t count, const size_t size);
+void* mem_realloc(void *ptr, const size_t size);
+void mem_free(void *ptr);
+
+#endif /* _ALLOCATOR_H_ */
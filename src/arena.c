@@ -0,0 +1,288 @@
+/**
+ * arena.c
+ * A bump allocator for the short lived allocations of a single render.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#include "arena.h"
+#include "allocator.h"
+#ifdef WINCE
+#include "sync.h"
+#endif
+#include <string.h>
+#ifdef UNIX
+#include <pthread.h>
+#endif
+
+// Sizing.
+#define ARENA_ALIGN       16
+#define ARENA_CHUNK_SIZE  16384
+#define ARENA_MAX_RETAIN  1048576
+#define ARENA_ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
+#define ARENA_HEADER      ARENA_ALIGN_UP(sizeof(arena_chunk_t))
+#define ARENA_DATA(c)     ((char*)(c) + ARENA_HEADER)
+
+// Arena reused by every render in a thread.
+#ifdef WINCE
+static DWORD arena_slot = TLS_OUT_OF_INDEXES;
+#else
+static THREAD_LOCAL arena_t thread_arena;
+#endif
+#ifdef UNIX
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t arena_key;
+#endif
+
+// Private methods.
+arena_chunk_t* arena_push_chunk(arena_t *arena, const size_t size);
+#ifdef UNIX
+void arena_key_create(void);
+void arena_thread_exit(void *arena);
+#endif
+
+/**
+ * Gets the arena used for the transient allocations of the renders done in
+ * the calling thread.
+ * @remark On UNIX the arena is freed automatically when the thread exits. On
+ *         Windows this is done by DllMain().
+ *
+ * @return Render arena of the calling thread.
+ */
+arena_t* render_arena(void) {
+#ifdef WINCE
+	arena_t *arena;
+	DWORD slot;
+
+	// Get ourselves a thread local storage slot the first time around.
+	if (sync_load(&arena_slot) == (LONG)TLS_OUT_OF_INDEXES) {
+		slot = TlsAlloc();
+		if (InterlockedCompareExchange((LONG*)&arena_slot, (LONG)slot,
+				(LONG)TLS_OUT_OF_INDEXES) != (LONG)TLS_OUT_OF_INDEXES) {
+			TlsFree(slot);
+		}
+	}
+
+	// Give this thread an arena of its own.
+	arena = (arena_t*)TlsGetValue(arena_slot);
+	if (arena == NULL) {
+		arena = (arena_t*)mem_calloc(1, sizeof(arena_t));
+		TlsSetValue(arena_slot, arena);
+	}
+
+	return arena;
+#else
+#ifdef UNIX
+	// Make sure we clean up after ourselves when the thread goes away.
+	if (!thread_arena.registered) {
+		pthread_once(&arena_key_once, arena_key_create);
+		pthread_setspecific(arena_key, &thread_arena);
+		thread_arena.registered = true;
+	}
+#endif
+
+	return &thread_arena;
+#endif
+}
+
+/**
+ * Frees the render arena of the calling thread, leaving the ones of every
+ * other thread untouched.
+ */
+void render_arena_release(void) {
+#ifdef WINCE
+	arena_t *arena;
+
+	// Nothing to do if this thread never rendered anything.
+	if (sync_load(&arena_slot) == (LONG)TLS_OUT_OF_INDEXES)
+		return;
+	arena = (arena_t*)TlsGetValue(arena_slot);
+	if (arena == NULL)
+		return;
+
+	TlsSetValue(arena_slot, NULL);
+	arena_free(arena);
+	mem_free(arena);
+#else
+	arena_free(&thread_arena);
+#endif
+}
+
+/**
+ * Opens an allocation scope. Scopes can be nested and everything allocated in
+ * the arena is only released once the outermost one is closed.
+ *
+ * @param arena Arena structure.
+ */
+void arena_begin(arena_t *arena) {
+	arena->depth++;
+}
+
+/**
+ * Closes an allocation scope, resetting the arena if it was the outermost one.
+ *
+ * @param arena Arena structure.
+ */
+void arena_end(arena_t *arena) {
+	if (--arena->depth == 0)
+		arena_reset(arena);
+}
+
+/**
+ * Allocates a block of memory from the arena.
+ *
+ * @param  arena Arena structure.
+ * @param  size  Size of the block.
+ * @return       Block of memory that is valid until the arena is reset.
+ */
+void* arena_alloc(arena_t *arena, const size_t size) {
+	arena_chunk_t *chunk = arena->chunk;
+	size_t asize = ARENA_ALIGN_UP(size);
+
+	// Get a new chunk if the current one can't hold the block.
+	if ((chunk == NULL) || ((chunk->size - chunk->used) < asize))
+		chunk = arena_push_chunk(arena, asize);
+
+	// Bump the pointer.
+	arena->last = ARENA_DATA(chunk) + chunk->used;
+	chunk->used += asize;
+
+	return arena->last;
+}
+
+/**
+ * Grows a block of memory allocated from the arena. The block is extended in
+ * place if it was the last one allocated and there's still room for it.
+ *
+ * @param  arena   Arena structure.
+ * @param  ptr     Block to be grown or NULL to allocate a new one.
+ * @param  oldsize Current size of the block.
+ * @param  newsize New size of the block.
+ * @return         Grown block of memory.
+ */
+void* arena_grow(arena_t *arena, void *ptr, const size_t oldsize,
+				 const size_t newsize) {
+	arena_chunk_t *chunk = arena->chunk;
+	size_t offset;
+	void *grown;
+
+	// Extend the last allocation in place.
+	if ((ptr != NULL) && (ptr == arena->last)) {
+		offset = (char*)ptr - ARENA_DATA(chunk);
+		if ((offset + ARENA_ALIGN_UP(newsize)) <= chunk->size) {
+			chunk->used = offset + ARENA_ALIGN_UP(newsize);
+			return ptr;
+		}
+	}
+
+	// Allocate a new block and copy the old contents over.
+	grown = arena_alloc(arena, newsize);
+	if (ptr != NULL)
+		memcpy(grown, ptr, (oldsize < newsize) ? oldsize : newsize);
+
+	return grown;
+}
+
+/**
+ * Copies a block out of the arena into the heap so it can outlive the render.
+ *
+ * @param  ptr  Block of memory to be copied.
+ * @param  size Size of the block.
+ * @return      Copy of the block. (Must be freed by the caller)
+ */
+void* arena_detach(const void *ptr, const size_t size) {
+	void *copy = mem_malloc((size > 0) ? size : 1);
+	memcpy(copy, ptr, size);
+
+	return copy;
+}
+
+/**
+ * Releases everything allocated from the arena. If the last renders didn't
+ * fit a single chunk they are coalesced into a bigger one the next time
+ * around, so a steady workload ends up never touching the heap.
+ *
+ * @param arena Arena structure.
+ */
+void arena_reset(arena_t *arena) {
+	arena_chunk_t *chunk = arena->chunk;
+
+	arena->last = NULL;
+	if (chunk == NULL)
+		return;
+
+	// Usual case: just rewind the only chunk we have.
+	if ((chunk->prev == NULL) && (chunk->size <= ARENA_MAX_RETAIN)) {
+		chunk->used = 0;
+		return;
+	}
+
+	// Remember how much we needed and give the chunks back to the heap.
+	arena->hint = (arena->total < ARENA_MAX_RETAIN) ? arena->total :
+		ARENA_MAX_RETAIN;
+	arena_free(arena);
+}
+
+/**
+ * Frees all the memory held by an arena.
+ *
+ * @param arena Arena structure.
+ */
+void arena_free(arena_t *arena) {
+	arena_chunk_t *chunk;
+
+	while ((chunk = arena->chunk) != NULL) {
+		arena->chunk = chunk->prev;
+		mem_free(chunk);
+	}
+
+	arena->total = 0;
+	arena->last = NULL;
+}
+
+#ifdef UNIX
+/**
+ * Creates the key used to get notified when a thread exits.
+ */
+void arena_key_create(void) {
+	pthread_key_create(&arena_key, arena_thread_exit);
+}
+
+/**
+ * Frees the render arena of a thread that is exiting.
+ *
+ * @param arena Render arena of the thread.
+ */
+void arena_thread_exit(void *arena) {
+	arena_free((arena_t*)arena);
+}
+#endif
+
+/**
+ * Allocates a new chunk and makes it the current one in the arena.
+ *
+ * @param  arena Arena structure.
+ * @param  size  Minimum size of the chunk.
+ * @return       The new chunk.
+ */
+arena_chunk_t* arena_push_chunk(arena_t *arena, const size_t size) {
+	arena_chunk_t *chunk;
+	size_t csize;
+
+	// Figure out the size of the chunk.
+	csize = (arena->chunk == NULL) ? arena->hint : arena->chunk->size * 2;
+	if (csize < ARENA_CHUNK_SIZE)
+		csize = ARENA_CHUNK_SIZE;
+	if (csize < size)
+		csize = size;
+
+	// Allocate it and put it on top of the others.
+	chunk = (arena_chunk_t*)mem_malloc(ARENA_HEADER + csize);
+	chunk->prev = arena->chunk;
+	chunk->size = csize;
+	chunk->used = 0;
+	arena->chunk = chunk;
+	arena->total += csize;
+
+	return chunk;
+}
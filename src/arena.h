@@ -0,0 +1,59 @@
+/**
+ * arena.h
+ * A bump allocator for the short lived allocations of a single render.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "windowshelper.h"
+#include <stdlib.h>
+#ifdef UNIX
+#include <stdbool.h>
+#endif
+
+// Thread local storage. (Windows CE only has the TlsAlloc() family)
+#ifdef WINDOWS
+#ifndef WINCE
+#define THREAD_LOCAL __declspec(thread)
+#endif
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Arena memory chunk.
+typedef struct arena_chunk_s {
+	struct arena_chunk_s *prev;
+	size_t size;
+	size_t used;
+} arena_chunk_t;
+
+// Arena structure.
+typedef struct {
+	arena_chunk_t *chunk;
+	size_t total;
+	size_t hint;
+	void *last;
+	unsigned int depth;
+	bool registered;
+} arena_t;
+
+// Render arena.
+arena_t* render_arena(void);
+void render_arena_release(void);
+
+// Scoping.
+void arena_begin(arena_t *arena);
+void arena_end(arena_t *arena);
+
+// Allocation.
+void* arena_alloc(arena_t *arena, const size_t size);
+void* arena_grow(arena_t *arena, void *ptr, const size_t oldsize,
+				 const size_t newsize);
+void* arena_detach(const void *ptr, const size_t size);
+void arena_reset(arena_t *arena);
+void arena_free(arena_t *arena);
+
+#endif /* _ARENA_H_ */
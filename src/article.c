@@ -8,31 +8,38 @@
 #include "article.h"
 #include "constants.h"
 #include "fileutils.h"
+#include "allocator.h"
+#include "strutils.h"
 #include <string.h>
 #include <stdio.h>
 
-// Global variables.
-const char *wiki_root_path;
-char article_path[UKI_MAX_PATH];
+// Initial number of hash table slots. (Must be a power of two)
+#define ARTICLE_INITIAL_SLOTS 16
 
 // Private methods.
 void push_article(uki_article_container *container, uki_article_t article);
-void populate_article_from_path(uki_article_t *article, const char *fpath);
+void insert_article_slot(uki_article_container *container,
+						 const unsigned long hash, const size_t index);
+void grow_article_slots(uki_article_container *container);
+void populate_article_from_path(const uki_article_container *container,
+								uki_article_t *article, const char *fpath);
 
 /**
  * Initializes an article container.
  *
- * @param container  Article container.
- * @param _wiki_root Wiki root path.
+ * @param container Article container.
+ * @param wiki_root Wiki root path.
  */
 void initialize_articles(uki_article_container *container,
-						 const char *_wiki_root) {
+						 const char *wiki_root) {
 	// Initialize paths.
-	wiki_root_path = _wiki_root;
-	pathcat(2, article_path, wiki_root_path, UKI_ARTICLE_ROOT);
+	pathcat(2, container->root, wiki_root, UKI_ARTICLE_ROOT);
 
 	container->size = 0;
-	container->list = malloc(sizeof(uki_article_t));
+	container->list = mem_malloc(sizeof(uki_article_t));
+	container->nslots = ARTICLE_INITIAL_SLOTS;
+	container->slots = mem_calloc(container->nslots,
+								  sizeof(uki_article_slot_t));
 }
 
 /**
@@ -51,6 +58,8 @@ uki_article_t find_article_i(const size_t index,
 		nl.path = NULL;
 		nl.parent = NULL;
 		nl.deepness = 0;
+		memset(&nl.info, 0, sizeof(file_info_t));
+		nl.deps = NULL;
 
 		return nl;
 	}
@@ -59,41 +68,126 @@ uki_article_t find_article_i(const size_t index,
 }
 
 /**
- * Pushes an article into the container.
+ * Gets an article index by its path, without touching the filesystem.
+ *
+ * @param  path      Article path relative to the articles root, with the
+ *                   extension. (As in uki_article_t.path)
+ * @param  container Article container to search into.
+ * @return           Article index in case it was found. A negative number
+ *                   otherwise.
+ */
+ssize_t find_article(const char *path, const uki_article_container container) {
+	unsigned long hash = strhash(path);
+	size_t mask = container.nslots - 1;
+	size_t i = hash & mask;
+
+	// Linear probing until we hit an empty slot.
+	while (container.slots[i].index != 0) {
+		const uki_article_slot_t *slot = &container.slots[i];
+
+		if ((slot->hash == hash) &&
+				(strcmp(path, container.list[slot->index - 1].path) == 0))
+			return (ssize_t)(slot->index - 1);
+
+		i = (i + 1) & mask;
+	}
+
+	return -1;
+}
+
+/**
+ * Pushes an article into the container and indexes it by its path.
  *
  * @param container Article container.
  * @param article   Article structure to be added.
  */
 void push_article(uki_article_container *container, uki_article_t article) {
-	container->list = realloc(container->list, sizeof(uki_article_t) *
+	container->list = mem_realloc(container->list, sizeof(uki_article_t) *
 							  (container->size + 1));
+
+	// Keep the hash table at most 3/4 full.
+	if (((container->size + 1) * 4) > (container->nslots * 3))
+		grow_article_slots(container);
+
+	// Index the article. In case of duplicate paths the first one wins.
+	if (find_article(article.path, *container) < 0) {
+		insert_article_slot(container, strhash(article.path),
+							container->size);
+	}
+
 	container->list[container->size++] = article;
 }
 
+/**
+ * Inserts an article index into the first free slot of the hash table.
+ *
+ * @param container Article container.
+ * @param hash      Hash of the article path.
+ * @param index     Index of the article in the list.
+ */
+void insert_article_slot(uki_article_container *container,
+						 const unsigned long hash, const size_t index) {
+	size_t mask = container->nslots - 1;
+	size_t i = hash & mask;
+
+	// Linear probing until we find a free slot.
+	while (container->slots[i].index != 0)
+		i = (i + 1) & mask;
+
+	container->slots[i].hash = hash;
+	container->slots[i].index = index + 1;
+}
+
+/**
+ * Doubles the size of the hash table and reinserts all the slots.
+ *
+ * @param container Article container.
+ */
+void grow_article_slots(uki_article_container *container) {
+	uki_article_slot_t *old = container->slots;
+	size_t nold = container->nslots;
+	size_t i;
+
+	// Allocate a new empty table.
+	container->nslots *= 2;
+	container->slots = mem_calloc(container->nslots,
+								  sizeof(uki_article_slot_t));
+
+	// Reinsert the old slots.
+	for (i = 0; i < nold; i++) {
+		if (old[i].index != 0)
+			insert_article_slot(container, old[i].hash, old[i].index - 1);
+	}
+
+	mem_free(old);
+}
+
 /**
  * Populates an article structure using a file path.
  * @remark This function ignores the article root path, but it must be present.
  *
- * @param article Article structure to be populated.
- * @param fpath   Complete file path. Article root part will be ignored.
+ * @param container Article container the article belongs to.
+ * @param article   Article structure to be populated.
+ * @param fpath     Complete file path. Article root part will be ignored.
  */
-void populate_article_from_path(uki_article_t *article, const char *fpath) {
+void populate_article_from_path(const uki_article_container *container,
+								uki_article_t *article, const char *fpath) {
 	const char *reldir = fpath;
 
 	// Skip the article root directory.
-	reldir += strlen(article_path);
+	reldir += strlen(container->root);
 
 	// Allocate memory and populate the structure.
-	article->name = (char*)malloc(basename_noext(NULL, reldir) *
+	article->name = (char*)mem_malloc(basename_noext(NULL, reldir) *
 								  sizeof(char));
-	article->path = (char*)malloc((strlen(reldir) + 1) * sizeof(char));
+	article->path = (char*)mem_malloc((strlen(reldir) + 1) * sizeof(char));
 	basename_noext(article->name, reldir);
 	strcpy(article->path, reldir);
 	article->deepness = path_deepness(article->path);
 
 	// Populate the parent path.
 	if (article->deepness > 0) {
-		article->parent = (char*)malloc(parent_dir_name(NULL, reldir) *
+		article->parent = (char*)mem_malloc(parent_dir_name(NULL, reldir) *
 										sizeof(char));
 		parent_dir_name(article->parent, reldir);
 	} else {
@@ -106,13 +200,22 @@ void populate_article_from_path(uki_article_t *article, const char *fpath) {
  *
  * @param  container Article container.
  * @param  fpath     Complete path to the article.
+ * @param  info      Article file metadata or NULL to look it up.
  * @return           The recently added article.
  */
-uki_article_t add_article(uki_article_container *container, const char *fpath) {
+uki_article_t add_article(uki_article_container *container, const char *fpath,
+						  const file_info_t *info) {
 	uki_article_t article;
 
 	// Populate article and push it into the container.
-	populate_article_from_path(&article, fpath);
+	populate_article_from_path(container, &article, fpath);
+	article.deps = (uki_article_deps_t**)mem_calloc(1,
+		sizeof(uki_article_deps_t*));
+	if (info != NULL) {
+		article.info = *info;
+	} else if (!file_info(&article.info, fpath)) {
+		memset(&article.info, 0, sizeof(file_info_t));
+	}
 	push_article(container, article);
 
 	return article;
@@ -122,23 +225,27 @@ uki_article_t add_article(uki_article_container *container, const char *fpath) {
  * Populates the articles container.
  *
  * @param  container Articles container.
+ * @param  nthreads  Number of threads scanning the folder. 1 scans it
+ *                   serially.
  * @return           UKI_OK if the operation was successful.
  */
-uki_error populate_articles(uki_article_container *container) {
+uki_error populate_articles(uki_article_container *container,
+							const size_t nthreads) {
 	dirlist_t dirlist;
 	int err;
 	size_t i;
 
 	// Go through the directory and sort the findings.
 	dirlist.size = 0;
-	if ((err = list_directory_files(&dirlist, article_path, true)) != UKI_OK)
+	err = list_directory_files_parallel(&dirlist, container->root, nthreads);
+	if (err != UKI_OK)
 		return err;
 	sort_dirlist(&dirlist);
 
 	// Push the files into the article container.
 	for (i = 0; i < dirlist.size; i++) {
 		if (file_ext_match(dirlist.list[i], UKI_ARTICLE_EXT))
-			add_article(container, dirlist.list[i]);
+			add_article(container, dirlist.list[i], &dirlist.info[i]);
 	}
 
 	// Clean up and return.
@@ -146,6 +253,41 @@ uki_error populate_articles(uki_article_container *container) {
 	return UKI_OK;
 }
 
+/**
+ * Makes a copy of a article container that can be changed without disturbing
+ * anyone still reading the original.
+ * @remark The copy shares the article strings and recorded variables with the
+ *         original, so only one of them can be freed with free_articles(). The
+ *         other one must be released with release_articles().
+ *
+ * @param clone     Article container to be populated.
+ * @param container Article container to be copied.
+ */
+void clone_articles(uki_article_container *clone,
+					const uki_article_container *container) {
+	strcpy(clone->root, container->root);
+	clone->size = container->size;
+	clone->list = mem_malloc(sizeof(uki_article_t) * ((clone->size > 0) ?
+							 clone->size : 1));
+	memcpy(clone->list, container->list, sizeof(uki_article_t) * clone->size);
+	clone->nslots = container->nslots;
+	clone->slots = mem_malloc(sizeof(uki_article_slot_t) * clone->nslots);
+	memcpy(clone->slots, container->slots,
+		   sizeof(uki_article_slot_t) * clone->nslots);
+}
+
+/**
+ * Frees an article container without freeing the article strings it shares
+ * with its clones.
+ *
+ * @param container Article container to be released.
+ */
+void release_articles(uki_article_container container) {
+	mem_free(container.list);
+	mem_free(container.slots);
+	container.size = 0;
+}
+
 /**
  * Cleans up the mess we left behind.
  *
@@ -154,11 +296,27 @@ uki_error populate_articles(uki_article_container *container) {
 void free_articles(uki_article_container container) {
 	size_t i;
 	for (i = 0; i < container.size; i++) {
-		free(container.list[i].path);
-		free(container.list[i].name);
-		free(container.list[i].parent);
+		mem_free(container.list[i].path);
+		mem_free(container.list[i].name);
+		mem_free(container.list[i].parent);
+		free_article_deps(*container.list[i].deps);
+		mem_free(container.list[i].deps);
 	}
 
-	free(container.list);
+	mem_free(container.list);
+	mem_free(container.slots);
 	container.size = 0;
 }
+
+/**
+ * Frees the variables recorded for an article.
+ *
+ * @param deps Recorded article variables. (Can be NULL)
+ */
+void free_article_deps(uki_article_deps_t *deps) {
+	if (deps == NULL)
+		return;
+
+	free_page_deps(&deps->deps);
+	mem_free(deps);
+}
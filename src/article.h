@@ -10,34 +10,61 @@
 
 #include "windowshelper.h"
 #include "constants.h"
+#include "fileutils.h"
+#include "template.h"
 #ifdef UNIX
 #include <stdlib.h>
 #include <stdint.h>
+#include <sys/types.h>
 #endif
 
+// Variables used by an article file. (Immutable once published)
+typedef struct {
+	file_info_t info;
+	uki_page_deps_t deps;
+} uki_article_deps_t;
+
 // Article structure.
 typedef struct {
 	char *path;
 	char *name;
 	char *parent;
 	int   deepness;
+	file_info_t info;
+	uki_article_deps_t **deps;
 } uki_article_t;
 
+// Article hash table slot.
+typedef struct {
+	unsigned long hash;
+	size_t index;
+} uki_article_slot_t;
+
 // Article container.
 typedef struct {
+	char root[UKI_MAX_PATH];
 	size_t size;
 	uki_article_t *list;
+	size_t nslots;
+	uki_article_slot_t *slots;
 } uki_article_container;
 
 // Memory management.
 void initialize_articles(uki_article_container *container,
-						 const char *_wiki_root);
-uki_article_t add_article(uki_article_container *container, const char *fpath);
-uki_error populate_articles(uki_article_container *container);
+						 const char *wiki_root);
+uki_article_t add_article(uki_article_container *container, const char *fpath,
+						  const file_info_t *info);
+uki_error populate_articles(uki_article_container *container,
+							const size_t nthreads);
+void clone_articles(uki_article_container *clone,
+					const uki_article_container *container);
+void release_articles(uki_article_container container);
 void free_articles(uki_article_container container);
+void free_article_deps(uki_article_deps_t *deps);
 
 // Lookup.
 uki_article_t find_article_i(const size_t index,
 							 const uki_article_container container);
+ssize_t find_article(const char *path, const uki_article_container container);
 
 #endif /* _ARTICLE_H_ */
@@ -0,0 +1,125 @@
+/**
+ * compress.c
+ * Compresses rendered pages so that they can be served precompressed.
+ *
+ * Compression is only available if the library was built with zlib (by
+ * defining UKI_ZLIB), otherwise every function here just reports failure.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#include "compress.h"
+#include "allocator.h"
+#include <string.h>
+#ifdef UKI_ZLIB
+#include <zlib.h>
+#endif
+
+// Window size and format of the compressed stream. (16 selects gzip)
+#define GZIP_WINDOW_BITS (15 + 16)
+#define GZIP_MEM_LEVEL   8
+
+#ifdef UKI_ZLIB
+// Private methods.
+voidpf gzip_alloc(voidpf opaque, uInt items, uInt size);
+void gzip_free(voidpf opaque, voidpf ptr);
+#endif
+
+/**
+ * Checks if we are able to compress anything.
+ *
+ * @return TRUE if the library was built with zlib.
+ */
+bool gzip_available(void) {
+#ifdef UKI_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Compresses a buffer into a gzip stream, suitable to be served as is with a
+ * "Content-Encoding: gzip" header.
+ * @remark Pages are compressed once and served many times, so this goes for
+ *         the best compression instead of the fastest.
+ *
+ * @param  out     Compressed data. (Allocated by this function)
+ * @param  out_len Length of the compressed data.
+ * @param  data    Data to be compressed.
+ * @param  len     Length of the data.
+ * @return         TRUE if the data was compressed.
+ */
+bool gzip_buffer(char **out, size_t *out_len, const char *data,
+				 const size_t len) {
+#ifdef UKI_ZLIB
+	z_stream zs;
+	uLong bound;
+
+	*out = NULL;
+	*out_len = 0;
+
+	// Set up the compressor to use our allocator.
+	memset(&zs, 0, sizeof(z_stream));
+	zs.zalloc = gzip_alloc;
+	zs.zfree = gzip_free;
+	if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, GZIP_WINDOW_BITS,
+					 GZIP_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	// Compress everything in a single pass into a buffer that's big enough.
+	bound = deflateBound(&zs, (uLong)len);
+	*out = (char*)mem_malloc(bound);
+	zs.next_in = (Bytef*)data;
+	zs.avail_in = (uInt)len;
+	zs.next_out = (Bytef*)*out;
+	zs.avail_out = (uInt)bound;
+	if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+		deflateEnd(&zs);
+		mem_free(*out);
+		*out = NULL;
+
+		return false;
+	}
+
+	// Give back what we didn't use.
+	*out_len = zs.total_out;
+	*out = (char*)mem_realloc(*out, *out_len);
+	deflateEnd(&zs);
+
+	return true;
+#else
+	(void)data;
+	(void)len;
+	*out = NULL;
+	*out_len = 0;
+
+	return false;
+#endif
+}
+
+#ifdef UKI_ZLIB
+/**
+ * Allocates memory for zlib through our allocator.
+ *
+ * @param  opaque Unused.
+ * @param  items  Number of items.
+ * @param  size   Size of each item.
+ * @return        Allocated memory.
+ */
+voidpf gzip_alloc(voidpf opaque, uInt items, uInt size) {
+	(void)opaque;
+	return mem_malloc((size_t)items * size);
+}
+
+/**
+ * Frees memory allocated for zlib.
+ *
+ * @param opaque Unused.
+ * @param ptr    Memory to be freed.
+ */
+void gzip_free(voidpf opaque, voidpf ptr) {
+	(void)opaque;
+	mem_free(ptr);
+}
+#endif
@@ -0,0 +1,24 @@
+/**
+ * compress.h
+ * Compresses rendered pages so that they can be served precompressed.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#ifndef _COMPRESS_H_
+#define _COMPRESS_H_
+
+#include "windowshelper.h"
+#include <stdlib.h>
+#ifdef UNIX
+#include <stdbool.h>
+#endif
+
+// Availability.
+bool gzip_available(void);
+
+// Compression.
+bool gzip_buffer(char **out, size_t *out_len, const char *data,
+				 const size_t len);
+
+#endif /* _COMPRESS_H_ */
@@ -6,13 +6,21 @@
  */
 
 #include "config.h"
+#include "strutils.h"
+#include "allocator.h"
 #include <string.h>
 #include <stdio.h>
 
 #define VAR_LINE_MATCH "%49[^=]=%99[0-9a-zA-Z '\".,;:!@#$%%^&*()_-+=][^\r\n]"
 
+// Initial number of hash table slots. (Must be a power of two)
+#define VARIABLE_INITIAL_SLOTS 16
+
 // Private methods.
 bool parse_variable_line(const char *line, uki_variable_t *var);
+void insert_variable_slot(uki_variable_container *container,
+						  const unsigned long hash, const size_t index);
+void grow_variable_slots(uki_variable_container *container);
 
 /**
  * Initializes a variable container.
@@ -21,7 +29,11 @@ bool parse_variable_line(const char *line, uki_variable_t *var);
  */
 void initialize_variables(uki_variable_container *container) {
 	container->size = 0;
-	container->list = malloc(sizeof(uki_variable_t));
+	container->capacity = 1;
+	container->list = mem_malloc(sizeof(uki_variable_t));
+	container->nslots = VARIABLE_INITIAL_SLOTS;
+	container->slots = mem_calloc(container->nslots,
+								  sizeof(uki_variable_slot_t));
 }
 
 /**
@@ -58,9 +70,7 @@ bool populate_variables(uki_variable_container *container, const char *fname) {
 		}
 
 		// Push variable into container.
-		container->list = realloc(container->list, sizeof(uki_variable_t) *
-								  (container->size + 1));
-		container->list[container->size++] = var;
+		push_variable(container, var);
 	}
 
 	// Clean up.
@@ -70,19 +80,92 @@ bool populate_variables(uki_variable_container *container, const char *fname) {
 	return true;
 }
 
+/**
+ * Pushes a variable into the container and indexes it by its key.
+ *
+ * @param container Variable container.
+ * @param var       Variable structure to be added. (Owned by the container)
+ */
+void push_variable(uki_variable_container *container, uki_variable_t var) {
+	unsigned long hash;
+
+	// Grow the variable list if needed.
+	if (container->size == container->capacity) {
+		container->capacity *= 2;
+		container->list = mem_realloc(container->list, sizeof(uki_variable_t) *
+								  container->capacity);
+	}
+
+	// Keep the hash table at most 3/4 full.
+	if (((container->size + 1) * 4) > (container->nslots * 3))
+		grow_variable_slots(container);
+
+	// Index the variable. In case of duplicate keys the first one wins.
+	hash = strhash(var.key);
+	if (find_variable_h(var.key, hash, *container) < 0)
+		insert_variable_slot(container, hash, container->size);
+
+	container->list[container->size++] = var;
+}
+
+/**
+ * Inserts a variable index into the first free slot of the hash table.
+ *
+ * @param container Variable container.
+ * @param hash      Hash of the variable key.
+ * @param index     Index of the variable in the list.
+ */
+void insert_variable_slot(uki_variable_container *container,
+						  const unsigned long hash, const size_t index) {
+	size_t mask = container->nslots - 1;
+	size_t i = hash & mask;
+
+	// Linear probing until we find a free slot.
+	while (container->slots[i].index != 0)
+		i = (i + 1) & mask;
+
+	container->slots[i].hash = hash;
+	container->slots[i].index = index + 1;
+}
+
+/**
+ * Doubles the size of the hash table and reinserts all the slots.
+ *
+ * @param container Variable container.
+ */
+void grow_variable_slots(uki_variable_container *container) {
+	uki_variable_slot_t *old = container->slots;
+	size_t nold = container->nslots;
+	size_t i;
+
+	// Allocate a new empty table.
+	container->nslots *= 2;
+	container->slots = mem_calloc(container->nslots,
+								  sizeof(uki_variable_slot_t));
+
+	// Reinsert the old slots.
+	for (i = 0; i < nold; i++) {
+		if (old[i].index != 0)
+			insert_variable_slot(container, old[i].hash, old[i].index - 1);
+	}
+
+	mem_free(old);
+}
+
 /**
  * Cleans up the mess we left behind.
  *
  * @param container Variable container to be emptied.
  */
 void free_variables(uki_variable_container container) {
-	uint8_t i;
+	size_t i;
 	for (i = 0; i < container.size; i++) {
-		free(container.list[i].key);
-		free(container.list[i].value);
+		mem_free(container.list[i].key);
+		mem_free(container.list[i].value);
 	}
 
-	free(container.list);
+	mem_free(container.list);
+	mem_free(container.slots);
 	container.size = 0;
 }
 
@@ -93,7 +176,7 @@ void free_variables(uki_variable_container container) {
  * @param  container Variable container to search into.
  * @return           The variable structure if it was found. NULL otherwise.
  */
-uki_variable_t find_variable_i(const uint8_t index,
+uki_variable_t find_variable_i(const size_t index,
 							   const uki_variable_container container) {
 	// Check if the index is out of bounds.
 	if (index >= container.size) {
@@ -116,12 +199,33 @@ uki_variable_t find_variable_i(const uint8_t index,
  * @return           Variable index in case it was found. A negative number
  *                   otherwise.
  */
-int find_variable(const char *key, const uki_variable_container container) {
-	uint8_t i;
-	for (i = 0; i < container.size; i++) {
-		if (strcmp(key, container.list[i].key) == 0) {
-			return i;
-		}
+ssize_t find_variable(const char *key, const uki_variable_container container) {
+	return find_variable_h(key, strhash(key), container);
+}
+
+/**
+ * Gets a variable index by its key using a precomputed hash of the key.
+ *
+ * @param  key       Variable key.
+ * @param  hash      Hash of the variable key as returned by strhash().
+ * @param  container Variable container to search into.
+ * @return           Variable index in case it was found. A negative number
+ *                   otherwise.
+ */
+ssize_t find_variable_h(const char *key, const unsigned long hash,
+						const uki_variable_container container) {
+	size_t mask = container.nslots - 1;
+	size_t i = hash & mask;
+
+	// Linear probing until we hit an empty slot.
+	while (container.slots[i].index != 0) {
+		const uki_variable_slot_t *slot = &container.slots[i];
+
+		if ((slot->hash == hash) &&
+				(strcmp(key, container.list[slot->index - 1].key) == 0))
+			return (ssize_t)(slot->index - 1);
+
+		i = (i + 1) & mask;
 	}
 
 	return -1;
@@ -145,8 +249,8 @@ bool parse_variable_line(const char *line, uki_variable_t *var) {
 	}
 
 	// Allocate space for everyone.
-	var->key = (char*)malloc((strlen(key) + 1) * sizeof(char));
-	var->value = (char*)malloc((strlen(value) + 1) * sizeof(char));
+	var->key = (char*)mem_malloc((strlen(key) + 1) * sizeof(char));
+	var->value = (char*)mem_malloc((strlen(value) + 1) * sizeof(char));
 
 	// Populate the variable structure.
 	strcpy(var->key, key);
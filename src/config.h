@@ -13,6 +13,7 @@
 #ifdef UNIX
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/types.h>
 #endif
 
 // Variable limits.
@@ -25,21 +26,33 @@ typedef struct {
 	char *value;
 } uki_variable_t;
 
+// Variable hash table slot.
+typedef struct {
+	unsigned long hash;
+	size_t index;
+} uki_variable_slot_t;
+
 // Variable container.
 typedef struct {
-	uint8_t size;
+	size_t size;
+	size_t capacity;
 	uki_variable_t *list;
+	size_t nslots;
+	uki_variable_slot_t *slots;
 } uki_variable_container;
 
 
 // Memory management.
 void initialize_variables(uki_variable_container *container);
 bool populate_variables(uki_variable_container *container, const char *fname);
+void push_variable(uki_variable_container *container, uki_variable_t var);
 void free_variables(uki_variable_container container);
 
 // Lookup.
-uki_variable_t find_variable_i(const uint8_t index,
+uki_variable_t find_variable_i(const size_t index,
 							   const uki_variable_container container);
-int find_variable(const char *key, const uki_variable_container container);
+ssize_t find_variable(const char *key, const uki_variable_container container);
+ssize_t find_variable_h(const char *key, const unsigned long hash,
+						const uki_variable_container container);
 
 #endif /* _CONFIG_H_ */
@@ -33,18 +33,33 @@ typedef int uki_error;
 #define UKI_ERROR_CONVERSION_AW -41
 #define UKI_ERROR_CONVERSION_WA -42
 #define UKI_ERROR_REGEX_ASSET_IMAGE -51
+#define UKI_ERROR_BUFFER_TOO_SMALL  -61
+#define UKI_ERROR_EXPORT_WRITE      -71
+#define UKI_ERROR_NO_COMPRESSION    -81
+#define UKI_ERROR_SHARED_CACHE      -82
 
 // Paths.
 #define UKI_MANIFEST_PATH "/MANIFEST.uki"
 #define UKI_VARIABLE_PATH "/VARIABLES.uki"
+#define UKI_EXPORT_STATE  "/.EXPORT-%08lX.uki"
 #define UKI_ARTICLE_ROOT  "/pages/"
 #define UKI_TEMPLATE_ROOT "/templates/"
 #define UKI_ASSETS_ROOT   "/assets/"
 #define UKI_ARTICLE_EXT   "htm"
 #define UKI_TEMPLATE_EXT  "htm"
+#define UKI_GZIP_EXT      "gz"
+
+// Cache modes.
+#define UKI_CACHE_VALIDATE   0
+#define UKI_CACHE_FROZEN     1
+#define UKI_CACHE_BACKGROUND 2
+
+// Default time between background cache refreshes in milliseconds.
+#define UKI_REFRESH_INTERVAL 1000
 
 // Variable keys.
 #define UKI_VAR_MAIN_TEMPLATE "main_template"
+#define UKI_VAR_SCAN_THREADS  "scan_threads"
 
 // Misc.
 #ifdef WINDOWS
@@ -0,0 +1,168 @@
+/**
+ * epoch.c
+ * Epoch based reclamation of the data shared between readers and writers.
+ *
+ * Readers never lock or wait: they just announce themselves in one of two
+ * counters, picked by the parity of the current epoch. Writers publish new
+ * data with an atomic pointer swap and retire the old data instead of freeing
+ * it. Retired data is only freed after the epoch has been advanced and the
+ * counter of the readers that might still see it has drained, so a writer
+ * never has to wait for the readers either.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#include "epoch.h"
+#include "allocator.h"
+
+// Private methods.
+void free_garbage(epoch_garbage_t *garbage);
+void collect_garbage(epoch_domain_t *domain);
+
+/**
+ * Initializes a reclamation domain.
+ *
+ * @param domain Reclamation domain.
+ */
+void epoch_init(epoch_domain_t *domain) {
+	domain->epoch = 1;
+	domain->readers[0] = 0;
+	domain->readers[1] = 0;
+	domain->pending = NULL;
+	domain->limbo = NULL;
+	mutex_init(&domain->lock);
+}
+
+/**
+ * Frees everything that is still waiting to be reclaimed and destroys the
+ * domain.
+ * @remark There must be no readers left when this is called.
+ *
+ * @param domain Reclamation domain.
+ */
+void epoch_destroy(epoch_domain_t *domain) {
+	free_garbage(domain->limbo);
+	free_garbage(domain->pending);
+	domain->limbo = NULL;
+	domain->pending = NULL;
+	mutex_destroy(&domain->lock);
+}
+
+/**
+ * Enters a read side section. Everything published in the domain that the
+ * reader gets hold of stays valid until it leaves the section.
+ * @remark Sections can be nested and may be left from a different thread.
+ *
+ * @param  domain Reclamation domain.
+ * @return        Token that must be handed over to epoch_leave().
+ */
+unsigned long epoch_enter(epoch_domain_t *domain) {
+	unsigned long epoch;
+
+	for (;;) {
+		// Announce ourselves as a reader of the current epoch.
+		epoch = sync_load(&domain->epoch);
+		sync_add(&domain->readers[epoch & 1], 1);
+
+		// Make sure it didn't change while we weren't looking.
+		if (sync_load(&domain->epoch) == epoch)
+			return epoch;
+		sync_add(&domain->readers[epoch & 1], -1);
+	}
+}
+
+/**
+ * Leaves a read side section.
+ *
+ * @param domain Reclamation domain.
+ * @param token  Token returned by epoch_enter().
+ */
+void epoch_leave(epoch_domain_t *domain, const unsigned long token) {
+	sync_add(&domain->readers[token & 1], -1);
+}
+
+/**
+ * Retires an object that has already been unpublished. It'll be freed once no
+ * reader can possibly be looking at it anymore.
+ * @remark The free function is called with the domain locked, so it must not
+ *         retire anything else into the same domain.
+ *
+ * @param domain  Reclamation domain.
+ * @param ptr     Object to be freed. (Can be NULL)
+ * @param free_fn Function used to free the object.
+ */
+void epoch_retire(epoch_domain_t *domain, void *ptr, void (*free_fn)(void*)) {
+	epoch_garbage_t *garbage;
+
+	if (ptr == NULL)
+		return;
+
+	// Queue the object up for the next epoch.
+	garbage = (epoch_garbage_t*)mem_malloc(sizeof(epoch_garbage_t));
+	garbage->ptr = ptr;
+	garbage->free_fn = free_fn;
+
+	mutex_lock(&domain->lock);
+	garbage->next = domain->pending;
+	domain->pending = garbage;
+	collect_garbage(domain);
+	mutex_unlock(&domain->lock);
+}
+
+/**
+ * Frees everything that was retired and is no longer visible to any reader.
+ *
+ * @param domain Reclamation domain.
+ */
+void epoch_collect(epoch_domain_t *domain) {
+	mutex_lock(&domain->lock);
+	collect_garbage(domain);
+	mutex_unlock(&domain->lock);
+}
+
+/**
+ * Frees whatever garbage is safe to be freed and advances the epoch if there's
+ * more waiting.
+ * @remark The domain must be locked.
+ *
+ * @param domain Reclamation domain.
+ */
+void collect_garbage(epoch_domain_t *domain) {
+	unsigned long epoch = sync_load(&domain->epoch);
+
+	// Free what was retired before the last epoch change once the readers
+	// that started before it are gone.
+	if ((domain->limbo != NULL) &&
+			(sync_load(&domain->readers[(epoch - 1) & 1]) == 0)) {
+		free_garbage(domain->limbo);
+		domain->limbo = NULL;
+	}
+
+	// Advance the epoch so that new readers can't see the pending garbage.
+	if ((domain->limbo == NULL) && (domain->pending != NULL)) {
+		domain->limbo = domain->pending;
+		domain->pending = NULL;
+		sync_store(&domain->epoch, epoch + 1);
+
+		if (sync_load(&domain->readers[epoch & 1]) == 0) {
+			free_garbage(domain->limbo);
+			domain->limbo = NULL;
+		}
+	}
+}
+
+/**
+ * Frees a list of retired objects.
+ *
+ * @param garbage First retired object in the list.
+ */
+void free_garbage(epoch_garbage_t *garbage) {
+	epoch_garbage_t *next;
+
+	while (garbage != NULL) {
+		next = garbage->next;
+		garbage->free_fn(garbage->ptr);
+		mem_free(garbage);
+		garbage = next;
+	}
+}
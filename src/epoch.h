@@ -0,0 +1,42 @@
+/**
+ * epoch.h
+ * Epoch based reclamation of the data shared between readers and writers.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+#include "windowshelper.h"
+#include "sync.h"
+
+// Retired object waiting to be freed.
+typedef struct epoch_garbage_s {
+	struct epoch_garbage_s *next;
+	void (*free_fn)(void *ptr);
+	void *ptr;
+} epoch_garbage_t;
+
+// Reclamation domain.
+typedef struct {
+	unsigned long epoch;
+	long readers[2];
+	mutex_t lock;
+	epoch_garbage_t *pending;
+	epoch_garbage_t *limbo;
+} epoch_domain_t;
+
+// Initialization and destruction.
+void epoch_init(epoch_domain_t *domain);
+void epoch_destroy(epoch_domain_t *domain);
+
+// Read side.
+unsigned long epoch_enter(epoch_domain_t *domain);
+void epoch_leave(epoch_domain_t *domain, const unsigned long token);
+
+// Write side.
+void epoch_retire(epoch_domain_t *domain, void *ptr, void (*free_fn)(void*));
+void epoch_collect(epoch_domain_t *domain);
+
+#endif /* _EPOCH_H_ */
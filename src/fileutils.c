@@ -7,25 +7,81 @@
 
 #include "fileutils.h"
 #include "strutils.h"
+#include "arena.h"
+#include "allocator.h"
+#include "pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
 #ifdef UNIX
 #include <unistd.h>
 #include <stdint.h>
 #include <dirent.h>
-#include <regex.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #endif
 
+// Files at least this big are mapped into memory instead of being read.
+#define FILE_VIEW_MAP_MIN (64 * 1024)
+
+// Number of paths a directory listing starts with room for.
+#define DIRLIST_INITIAL_SIZE 64
+
+// Directory listing entry while it's being sorted.
+typedef struct {
+	char *path;
+	const char *name;
+	file_info_t info;
+} dirlist_entry_t;
+
+// Directory waiting to be scanned by a parallel listing.
+typedef struct dirscan_dir_s {
+	char *path;
+	struct dirscan_dir_s *next;
+} dirscan_dir_t;
+
+// Parallel directory listing job.
+typedef struct {
+	size_t nwalkers;
+	dirlist_t *lists;
+	size_t *capacities;
+	dirscan_dir_t *queue;
+	size_t pending;
+	ssize_t err;
+	mutex_t lock;
+	semaphore_t ready;
+} dirscan_t;
+
 // Private methods.
 #ifdef WINDOWS
-int __cdecl sort_dirs_ascending(const void *a, const void *b);
+int __cdecl sort_runs_ascending(const void *a, const void *b);
+int __cdecl sort_entries_ascending(const void *a, const void *b);
+void filetime_info(file_info_t *info, const FILETIME *ftime, const DWORD size);
 #else
-int sort_dirs_ascending(const void *a, const void *b);
+int sort_runs_ascending(const void *a, const void *b);
+int sort_entries_ascending(const void *a, const void *b);
+void stat_file_info(file_info_t *info, const struct stat *st);
+size_t read_fd(int fd, char *buf, const size_t size);
 #endif
-ssize_t n_list_directory_files(size_t init_count, dirlist_t *list,
-							   const char *path, const bool recursive);
+void push_dirlist(dirlist_t *list, size_t *capacity, const char *path,
+				  const size_t len, const file_info_t *info);
+void push_dirrun(dirlist_t *list, const size_t start, const size_t prefix);
+#ifdef WINDOWS
+ssize_t scan_directory(dirlist_t *list, size_t *capacity, const char *path,
+					   const bool recursive, dirscan_t *scan);
+#else
+ssize_t scan_directory(dirlist_t *list, size_t *capacity, int fd, char *path,
+					   size_t len, const bool recursive, dirscan_t *scan);
+#endif
+void queue_directory(dirscan_t *scan, const char *path, const size_t len);
+void walk_directories(void *arg, const size_t item);
+bool match_image_src(const char *tag, const char *end, const char **src,
+					 size_t *len);
+bool strnmatch_nocase(const char *str, const char *pattern, const size_t len);
 
 /**
  * Substitutes assets paths inside a HTML page to map to the Uki assets folder.
@@ -35,59 +91,136 @@ ssize_t n_list_directory_files(size_t init_count, dirlist_t *list,
  * @return          UKI_OK if the substitutions were made successfully.
  */
 uki_error substitute_assets(char **html, const int deepness) {
+	arena_t *arena = render_arena();
+	strbuf_t out;
+
+	// Render the page with the substituted paths and swap the contents.
+	arena_begin(arena);
+	strbuf_init_arena(&out, arena, strlen(*html) + 1);
+	render_assets(&out, *html, strlen(*html), deepness);
+	mem_free(*html);
+	*html = strbuf_detach(&out);
+	arena_end(arena);
+
+	return UKI_OK;
+}
+
+/**
+ * Appends a HTML page to a string builder substituting the assets paths to
+ * map to the Uki assets folder.
+ *
+ * @param out      String builder to render into.
+ * @param html     HTML page content. (Doesn't need to be NULL terminated)
+ * @param len      Length of the HTML page content.
+ * @param deepness How deep inside the articles folder is this article.
+ */
+void render_assets(strbuf_t *out, const char *html, const size_t len,
+				   const int deepness) {
 #ifdef WINDOWS
+	strbuf_append(out, html, len);
 #else
-	regex_t regex;
-	char *cursor;
-	uki_error err;
-	regmatch_t pmatch[2];
-    size_t nmatch = 2;
-
-	// Compile the image asset regex.
-	if ((err = regcomp(&regex, "<img\\s+src=\"([^\"]+)\"",
-					   REG_EXTENDED | REG_ICASE)) != 0)
-		return UKI_ERROR_REGEX_ASSET_IMAGE;
-
-	// Go through the content looking for matches.
-	cursor = *html;
-	while (regexec(&regex, cursor, nmatch, pmatch, 0) == 0) {
-		int ibp;
-		spos_t pos;
+	const char *end = html + len;
+	const char *start = html;
+	const char *cursor = html;
+	const char *tag;
+	char backpath[UKI_MAX_PATH];
+	int ibp;
+
+	// Create the backwards path.
+	backpath[0] = '\0';
+	for (ibp = -1; ibp < deepness; ibp++) {
+		strcat(backpath, "../");
+	}
+
+	// Go through the content looking for image tags.
+	while ((tag = memchr(cursor, '<', end - cursor)) != NULL) {
+		const char *src;
 		size_t mlen;
-		size_t lppos;
 		char oldpath[UKI_MAX_PATH];
 		char newpath[UKI_MAX_PATH];
-		char backpath[UKI_MAX_PATH];
 
-		// Store the last cursor position.
-		lppos = cursor - *html;
+		// Check if this is really an image tag.
+		if (!match_image_src(tag, end, &src, &mlen)) {
+			cursor = tag + 1;
+			continue;
+		}
 
 		// Get the old path.
-		mlen = pmatch[1].rm_eo - pmatch[1].rm_so;
-		strncpy(oldpath, cursor + pmatch[1].rm_so, mlen);
+		if (mlen >= UKI_MAX_PATH)
+			mlen = UKI_MAX_PATH - 1;
+		memcpy(oldpath, src, mlen);
 		oldpath[mlen] = '\0';
 
-		// Create the backwards path.
-		backpath[0] = '\0';
-		for (ibp = -1; ibp < deepness; ibp++) {
-			strcat(backpath, "../");
-		}
-
-		// Create a subsitution position structure.
-		pos.begin = (size_t)(lppos + pmatch[1].rm_so);
-		pos.end = (size_t)(lppos + pmatch[1].rm_eo);
-
-		// Build the new path and substitute it in the page.
+		// Append everything up to the old path and the new path in its place.
 		pathcat(3, newpath, backpath, UKI_ASSETS_ROOT, oldpath);
-		strnreplace(html, pos, newpath);
+		strbuf_append(out, start, src - start);
+		strbuf_appends(out, newpath);
 
-		// Skip out cursor to the end of the substituted string.
-		cursor = *html + lppos + pmatch[1].rm_so + strlen(newpath);
+		// Skip our cursor to the end of the old path.
+		start = src + mlen;
+		cursor = start;
 	}
 
-	regfree(&regex);
+	// Append whatever is left.
+	strbuf_append(out, start, end - start);
 #endif
-	return UKI_OK;
+}
+
+/**
+ * Checks if there's an image tag (<img src="...">) at a position of a HTML page
+ * and gets the position of its source path.
+ *
+ * @param  tag Position of the tag opening character.
+ * @param  end End of the HTML page content.
+ * @param  src Start of the image source path.
+ * @param  len Length of the image source path.
+ * @return     TRUE if an image tag with a source was found.
+ */
+bool match_image_src(const char *tag, const char *end, const char **src,
+					 size_t *len) {
+	const char *cursor;
+
+	// Check for the tag name followed by some whitespace.
+	if (((end - tag) < 5) || !strnmatch_nocase(tag, "<img", 4) ||
+			!isspace((unsigned char)tag[4]))
+		return false;
+
+	// Skip the whitespace and check for the source attribute.
+	cursor = tag + 4;
+	while ((cursor < end) && isspace((unsigned char)*cursor))
+		cursor++;
+	if (((end - cursor) < 5) || !strnmatch_nocase(cursor, "src=\"", 5))
+		return false;
+
+	// Find the end of the source path.
+	*src = cursor + 5;
+	cursor = *src;
+	while ((cursor < end) && (*cursor != '"'))
+		cursor++;
+	if ((cursor == end) || (cursor == *src))
+		return false;
+
+	*len = cursor - *src;
+	return true;
+}
+
+/**
+ * Compares the beginning of a string against a lowercase pattern ignoring the
+ * case of the string.
+ *
+ * @param  str     String to be checked. (Must have at least len characters)
+ * @param  pattern Lowercase pattern to compare against.
+ * @param  len     Number of characters to compare.
+ * @return         TRUE if the string starts with the pattern.
+ */
+bool strnmatch_nocase(const char *str, const char *pattern, const size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		if (tolower((unsigned char)str[i]) != pattern[i])
+			return false;
+	}
+
+	return true;
 }
 
 /**
@@ -303,11 +436,54 @@ size_t cleanup_path(char *path) {
 
 /**
  * Sorts a directory listing alphabetically, giving priority to directories.
+ * @remark Each directory's files are sorted on their own and then laid out in
+ *         the order of their directories, so the deepness of a path is only
+ *         ever worked out once per directory.
  *
  * @param list Directory listing structure.
  */
 void sort_dirlist(dirlist_t *list) {
-	qsort(list->list, list->size, sizeof(char*), sort_dirs_ascending);
+	dirlist_entry_t *entries;
+	dirlist_run_t *runs;
+	const dirlist_run_t *run;
+	size_t pos;
+	size_t i;
+	size_t j;
+
+	if (list->size == 0)
+		return;
+
+	// Put the directories in order first.
+	runs = (dirlist_run_t*)mem_malloc(sizeof(dirlist_run_t) * list->nruns);
+	memcpy(runs, list->runs, sizeof(dirlist_run_t) * list->nruns);
+	qsort(runs, list->nruns, sizeof(dirlist_run_t), sort_runs_ascending);
+
+	// Lay their files out in that order, sorting each directory by name.
+	entries = (dirlist_entry_t*)mem_malloc(sizeof(dirlist_entry_t) *
+										   list->size);
+	for (pos = 0, i = 0; i < list->nruns; i++) {
+		run = &runs[i];
+		for (j = 0; j < run->count; j++) {
+			entries[pos + j].path = list->list[run->start + j];
+			entries[pos + j].name = entries[pos + j].path + run->prefix;
+			entries[pos + j].info = list->info[run->start + j];
+		}
+		qsort(entries + pos, run->count, sizeof(dirlist_entry_t),
+			  sort_entries_ascending);
+
+		list->runs[i] = *run;
+		list->runs[i].start = pos;
+		pos += run->count;
+	}
+
+	// Copy the sorted listing back.
+	for (i = 0; i < list->size; i++) {
+		list->list[i] = entries[i].path;
+		list->info[i] = entries[i].info;
+	}
+
+	mem_free(entries);
+	mem_free(runs);
 }
 
 /**
@@ -321,57 +497,225 @@ void sort_dirlist(dirlist_t *list) {
  */
 ssize_t list_directory_files(dirlist_t *list, const char *path,
 							 const bool recursive) {
+	char root[UKI_MAX_PATH];
+	size_t capacity;
 	ssize_t err;
+#ifdef UNIX
+	size_t len;
+	int fd;
+#endif
+
+	// Start with an empty listing that grows as we find files.
+	capacity = 0;
+	list->size = 0;
+	list->list = NULL;
+	list->info = NULL;
+	list->nruns = 0;
+	list->runs = NULL;
+
+#ifdef WINDOWS
+	pathcat(1, root, path);
+	err = scan_directory(list, &capacity, root, recursive, NULL);
+#else
+	// Walk the tree from the descriptor of its root in a single pass.
+	len = pathcat(1, root, path);
+	fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return UKI_ERROR_DIRLIST_NOTFOUND;
+	err = scan_directory(list, &capacity, fd, root, len, recursive, NULL);
+#endif
+
+	// Don't leave a half built listing behind.
+	if (err < 0) {
+		free_dirlist(*list);
+		list->size = 0;
+		list->list = NULL;
+		list->info = NULL;
+		list->nruns = 0;
+		list->runs = NULL;
 
-	if ((err = n_list_directory_files(0, list, path, recursive)) < 0)
 		return err;
+	}
 
 	return UKI_OK;
 }
 
 /**
- * Lists the directory contents and stores it in a directory listing structure.
- * @remark  If list is NULL this function will return the size of the list to be
- *          allocated.
+ * Lists all the files in a directory tree, scanning its subdirectories
+ * concurrently. Meant for trees on storage where every directory read has to
+ * wait on the network or the disk for a while.
+ * @remark The listing isn't in any particular order, so sort it afterwards.
  * @warning Always set the dirlist_t.size to 0 before calling this function.
  *
- * @param  init_count Initial counter position.
- * @param  list       Directory list container. Allocated by this function.
- * @param  path       Path to the directory you want to list.
- * @param  recursive  Should this listing be done recursively?
- * @return            Current count if populating or list size if *list is NULL.
+ * @param  list     Directory list container. Allocated by this function.
+ * @param  path     Path to the directory you want to list.
+ * @param  nthreads Number of threads scanning the tree. 1 scans it serially.
+ * @return          UKI_OK if everything went OK.
  */
-ssize_t n_list_directory_files(size_t init_count, dirlist_t *list,
-							   const char *path, const bool recursive) {
-	char subpath[UKI_MAX_PATH];
-	ssize_t count = init_count;
-	ssize_t err;
+ssize_t list_directory_files_parallel(dirlist_t *list, const char *path,
+									  const size_t nthreads) {
+	char root[UKI_MAX_PATH];
+	dirscan_t scan;
+	pool_t pool;
+	size_t total;
+	size_t len;
+	size_t i;
+	size_t j;
+
+	// Not worth starting threads for.
+	if (nthreads < 2)
+		return list_directory_files(list, path, true);
+
+	// Every walker collects the files it finds in its own listing.
+	scan.nwalkers = nthreads;
+	scan.lists = (dirlist_t*)mem_calloc(nthreads, sizeof(dirlist_t));
+	scan.capacities = (size_t*)mem_calloc(nthreads, sizeof(size_t));
+	scan.queue = NULL;
+	scan.pending = 0;
+	scan.err = UKI_OK;
+	mutex_init(&scan.lock);
+	semaphore_init(&scan.ready);
+
+	// Hand the root to the walkers and let them go through the tree.
+	len = pathcat(1, root, path);
+	queue_directory(&scan, root, len);
+	pool_init(&pool, nthreads - 1);
+	pool_run(&pool, walk_directories, &scan, nthreads);
+	pool_destroy(&pool);
+
+	// Merge everything that was found into a single listing.
+	total = 0;
+	for (i = 0; i < nthreads; i++)
+		total += scan.lists[i].size;
+	list->size = 0;
+	list->list = (char**)mem_malloc(sizeof(char*) * ((total > 0) ? total : 1));
+	list->info = (file_info_t*)mem_malloc(sizeof(file_info_t) *
+										  ((total > 0) ? total : 1));
+	list->nruns = 0;
+	list->runs = NULL;
+	for (i = 0; i < nthreads; i++) {
+		memcpy(list->list + list->size, scan.lists[i].list,
+			   sizeof(char*) * scan.lists[i].size);
+		memcpy(list->info + list->size, scan.lists[i].info,
+			   sizeof(file_info_t) * scan.lists[i].size);
+
+		// Directories are kept track of, but they now start further along.
+		list->runs = (dirlist_run_t*)mem_realloc(list->runs,
+			sizeof(dirlist_run_t) * (list->nruns + scan.lists[i].nruns));
+		for (j = 0; j < scan.lists[i].nruns; j++) {
+			list->runs[list->nruns] = scan.lists[i].runs[j];
+			list->runs[list->nruns++].start += list->size;
+		}
+
+		list->size += scan.lists[i].size;
+		mem_free(scan.lists[i].list);
+		mem_free(scan.lists[i].info);
+		mem_free(scan.lists[i].runs);
+	}
+
+	// Clean up.
+	semaphore_destroy(&scan.ready);
+	mutex_destroy(&scan.lock);
+	mem_free(scan.capacities);
+	mem_free(scan.lists);
+
+	// Don't leave a half built listing behind.
+	if (scan.err < 0) {
+		free_dirlist(*list);
+		list->size = 0;
+		list->list = NULL;
+		list->info = NULL;
+		list->nruns = 0;
+		list->runs = NULL;
+
+		return scan.err;
+	}
+
+	return UKI_OK;
+}
+
+/**
+ * Appends a file path to a directory listing, growing it as needed.
+ *
+ * @param list     Directory list container.
+ * @param capacity Number of paths the listing has room for.
+ * @param path     File path to be appended.
+ * @param len      Length of the file path.
+ * @param info     File metadata.
+ */
+void push_dirlist(dirlist_t *list, size_t *capacity, const char *path,
+				  const size_t len, const file_info_t *info) {
+	// Make some room.
+	if (list->size == *capacity) {
+		*capacity = (*capacity > 0) ? (*capacity * 2) : DIRLIST_INITIAL_SIZE;
+		list->list = (char**)mem_realloc(list->list,
+										 sizeof(char*) * *capacity);
+		list->info = (file_info_t*)mem_realloc(list->info,
+											   sizeof(file_info_t) * *capacity);
+	}
+
+	list->list[list->size] = (char*)mem_malloc((len + 1) * sizeof(char));
+	memcpy(list->list[list->size], path, len + 1);
+	list->info[list->size] = *info;
+	list->size++;
+}
+
+/**
+ * Marks the files that were just appended to a directory listing as the ones
+ * from a single directory.
+ *
+ * @param list   Directory list container.
+ * @param start  Index of the first file of the directory.
+ * @param prefix Length of the directory part of the file paths.
+ */
+void push_dirrun(dirlist_t *list, const size_t start, const size_t prefix) {
+	dirlist_run_t *run;
+
+	// Don't bother with directories without files.
+	if (list->size == start)
+		return;
+
+	list->runs = mem_realloc(list->runs, sizeof(dirlist_run_t) *
+							 (list->nruns + 1));
+	run = &list->runs[list->nruns++];
+	run->start = start;
+	run->count = list->size - start;
+	run->prefix = prefix;
+	run->deepness = path_deepness(list->list[start]);
+	run->sample = list->list[start];
+}
 
 #ifdef WINDOWS
+/**
+ * Scans a directory and appends its files to a directory listing.
+ * @remark Subdirectories are only scanned after all the files, so that every
+ *         directory's files end up together.
+ *
+ * @param  list      Directory list container.
+ * @param  capacity  Number of paths the listing has room for.
+ * @param  path      Path to the directory to be scanned.
+ * @param  recursive Should subdirectories also be scanned?
+ * @param  scan      Parallel listing to hand subdirectories over to or NULL
+ *                   to scan them right away.
+ * @return           UKI_OK if everything went OK.
+ */
+ssize_t scan_directory(dirlist_t *list, size_t *capacity, const char *path,
+					   const bool recursive, dirscan_t *scan) {
+	char subpath[UKI_MAX_PATH];
+	char **subdirs;
+	size_t nsubdirs;
+	size_t start;
+	size_t prefix;
+	file_info_t info;
+	size_t len;
+	size_t i;
+	ssize_t err;
 	HANDLE hFind;
 	WIN32_FIND_DATA fndData;
 	char fpath[UKI_MAX_PATH];
 	WCHAR szPathW[UKI_MAX_PATH];
 	char szFilename[UKI_MAX_PATH];
-#else
-	DIR *dh;
-	struct dirent *dir;
-#endif
-
-	// Allocate space for our list if needed.
-	if (list != NULL) {
-		if (list->size == 0) {
-			err = n_list_directory_files(0, NULL, path, recursive);
-			if (err < 0)
-				return err;
 
-			// Allocate listing array.
-			list->size = err;
-			list->list = (char**)malloc(err * sizeof(char*));
-		}
-	}
-
-#ifdef WINDOWS
 	// Add the wildcard for the file search function and convert to Unicode.
 	pathcat(2, fpath, path, "/*");
 	if (!StringAtoW(szPathW, fpath))
@@ -379,111 +723,303 @@ ssize_t n_list_directory_files(size_t init_count, dirlist_t *list,
 
 	// Find the first file in the directory.
 	hFind = FindFirstFile(szPathW, &fndData);
-#else
-	// Open directory for listing.
-	dh = opendir(path);
-	if (dh == NULL) {
-		return UKI_ERROR_DIRLIST_NOTFOUND;
-	}
-#endif
 
-	// Read directory contents recursively.
-#ifdef WINDOWS
+	// Read directory contents.
+	err = UKI_OK;
+	subdirs = NULL;
+	nsubdirs = 0;
+	start = list->size;
+	prefix = 0;
 	while (hFind != INVALID_HANDLE_VALUE) {
 		// Convert the filename to a normal string.
-		if(!StringWtoA(szFilename, fndData.cFileName))
-			return UKI_ERROR_CONVERSION_WA;
-#else
-	while ((dir = readdir(dh)) != NULL) {
-#endif
+		if (!StringWtoA(szFilename, fndData.cFileName)) {
+			FindClose(hFind);
+			err = UKI_ERROR_CONVERSION_WA;
+			goto cleanup;
+		}
+
 		// Ignore anything that starts with a dot.
-#ifdef WINDOWS
-		if (szFilename[0] == '.') {
+		if (szFilename[0] == '.')
 			goto nextfile;
-		}
-#else
-		if (dir->d_name[0] == '.') {
-			continue;
-		}
-#endif
 
 		// Decide what to do.
-#ifdef WINDOWS
 		switch (fndData.dwFileAttributes) {
 		case FILE_ATTRIBUTE_DIRECTORY:
-#else
-		switch (dir->d_type) {
-		case DT_DIR:
-#endif
 			// Is a directory, so only do something if we are recursive.
 			if (recursive) {
-				// Build path.
-#ifdef WINDOWS
-				pathcat(2, subpath, path, szFilename);
-#else
-				pathcat(2, subpath, path, dir->d_name);
-#endif
-
-				// Get listing recursively.
-				err = n_list_directory_files(count, list, subpath, recursive);
-				if (err < 0)
-					return err;
-
-				// Count up.
-				count += (err - count);
+				len = pathcat(2, subpath, path, szFilename);
+				if (scan != NULL) {
+					queue_directory(scan, subpath, len);
+					break;
+				}
+
+				// Leave it for when we are done with this one.
+				subdirs = (char**)mem_realloc(subdirs, sizeof(char*) *
+											  (nsubdirs + 1));
+				subdirs[nsubdirs] = (char*)mem_malloc((len + 1) * sizeof(char));
+				strcpy(subdirs[nsubdirs++], subpath);
 			}
 			break;
-#ifdef WINDOWS
 		case FILE_ATTRIBUTE_NORMAL:
 #ifdef WINCE
 		case FILE_ATTRIBUTE_ARCHIVE:
 #endif
-#else
-		case DT_REG:
-#endif
-			if (list != NULL) {
-				// Build path to file.
-#ifdef WINDOWS
-				pathcat(2, subpath, path, szFilename);
-#else
-				pathcat(2, subpath, path, dir->d_name);
-#endif
-
-				// Allocate string.
-				list->list[count] = (char*)malloc((strlen(subpath) + 1) *
-												  sizeof(char));
-				strcpy(list->list[count], subpath);
-			}
-
-			count++;
+			// The metadata comes along with the search for free.
+			len = pathcat(2, subpath, path, szFilename);
+			filetime_info(&info, &fndData.ftLastWriteTime,
+						  fndData.nFileSizeLow);
+			push_dirlist(list, capacity, subpath, len, &info);
+			prefix = len - strlen(szFilename);
 			break;
-#ifdef UNIX
-		case DT_UNKNOWN:
-			return UKI_ERROR_DIRLIST_FILEUNKNOWN;
-#endif
 		}
 
-#ifdef WINDOWS
 nextfile:
 		// Continue to the next file.
 		if (FindNextFile(hFind, &fndData) == 0) {
-			if (GetLastError() == ERROR_NO_MORE_FILES) {
-				// If there are no more files, close the handle and return.
-				FindClose(hFind);
-				hFind = INVALID_HANDLE_VALUE;
-			} else {
-				return UKI_ERROR;
+			err = (GetLastError() == ERROR_NO_MORE_FILES) ? UKI_OK : UKI_ERROR;
+			FindClose(hFind);
+			hFind = INVALID_HANDLE_VALUE;
+
+			if (err < 0)
+				goto cleanup;
+		}
+	}
+
+	push_dirrun(list, start, prefix);
+
+	// Go through the subdirectories.
+	for (i = 0; i < nsubdirs; i++) {
+		err = scan_directory(list, capacity, subdirs[i], recursive, NULL);
+		if (err < 0)
+			break;
+	}
+
+cleanup:
+	for (i = 0; i < nsubdirs; i++)
+		mem_free(subdirs[i]);
+	mem_free(subdirs);
+
+	return err;
+}
+#else
+/**
+ * Scans a directory and appends its files to a directory listing.
+ * @remark Subdirectories are opened relative to their parent's descriptor and
+ *         their paths are built in place, so nothing is looked up twice. They
+ *         are only scanned after all the files, so that every directory's
+ *         files end up together.
+ *
+ * @param  list      Directory list container.
+ * @param  capacity  Number of paths the listing has room for.
+ * @param  fd        Open descriptor of the directory. Closed by this function.
+ * @param  path      Buffer holding the path of the directory. Used as scratch
+ *                   space for the paths of its entries.
+ * @param  len       Length of the directory path.
+ * @param  recursive Should subdirectories also be scanned?
+ * @param  scan      Parallel listing to hand subdirectories over to or NULL
+ *                   to scan them right away.
+ * @return           UKI_OK if everything went OK.
+ */
+ssize_t scan_directory(dirlist_t *list, size_t *capacity, int fd, char *path,
+					   size_t len, const bool recursive, dirscan_t *scan) {
+	DIR *dh;
+	struct dirent *dir;
+	struct stat st;
+	file_info_t info;
+	char **subdirs;
+	size_t nsubdirs;
+	size_t namelen;
+	size_t start;
+	size_t i;
+	ssize_t err;
+	int subfd;
+	int type;
+
+	// Take over the descriptor for listing.
+	dh = fdopendir(fd);
+	if (dh == NULL) {
+		close(fd);
+		return UKI_ERROR_DIRLIST_NOTFOUND;
+	}
+
+	// Entries get appended to the directory path.
+	if ((len > 0) && (path[len - 1] != '/'))
+		path[len++] = '/';
+
+	err = UKI_OK;
+	subdirs = NULL;
+	nsubdirs = 0;
+	start = list->size;
+	while ((dir = readdir(dh)) != NULL) {
+		// Ignore anything that starts with a dot.
+		if (dir->d_name[0] == '.')
+			continue;
+
+		// Build the path to the entry.
+		namelen = strlen(dir->d_name);
+		if ((len + namelen) >= UKI_MAX_PATH)
+			continue;
+		memcpy(path + len, dir->d_name, namelen + 1);
+
+		// Some filesystems don't tell us what the entry is, so we ask.
+		type = dir->d_type;
+		if (type == DT_UNKNOWN) {
+			if (fstatat(dirfd(dh), dir->d_name, &st,
+						AT_SYMLINK_NOFOLLOW) != 0) {
+				continue;
+			}
+
+			if (S_ISDIR(st.st_mode)) {
+				type = DT_DIR;
+			} else if (S_ISREG(st.st_mode)) {
+				type = DT_REG;
 			}
 		}
-#endif
+
+		// Decide what to do.
+		switch (type) {
+		case DT_DIR:
+			// Is a directory, so only do something if we are recursive.
+			if (recursive) {
+				if (scan != NULL) {
+					queue_directory(scan, path, len + namelen);
+					break;
+				}
+
+				// Leave it for when we are done with this one.
+				subdirs = (char**)mem_realloc(subdirs, sizeof(char*) *
+											  (nsubdirs + 1));
+				subdirs[nsubdirs] = (char*)mem_malloc((namelen + 1) *
+													  sizeof(char));
+				memcpy(subdirs[nsubdirs++], dir->d_name, namelen + 1);
+			}
+			break;
+		case DT_REG:
+			// Grab its metadata while we are here, unless we already did.
+			if ((dir->d_type != DT_UNKNOWN) &&
+					(fstatat(dirfd(dh), dir->d_name, &st,
+							 AT_SYMLINK_NOFOLLOW) != 0)) {
+				break;
+			}
+
+			stat_file_info(&info, &st);
+			push_dirlist(list, capacity, path, len + namelen, &info);
+			break;
+		}
+	}
+	push_dirrun(list, start, len);
+
+	// Go through the subdirectories.
+	for (i = 0; i < nsubdirs; i++) {
+		namelen = strlen(subdirs[i]);
+		memcpy(path + len, subdirs[i], namelen + 1);
+
+		subfd = openat(dirfd(dh), subdirs[i],
+					   O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (subfd < 0) {
+			err = UKI_ERROR_DIRLIST_NOTFOUND;
+			break;
+		}
+
+		err = scan_directory(list, capacity, subfd, path, len + namelen,
+							 recursive, NULL);
+		if (err < 0)
+			break;
 	}
 
-#ifdef UNIX
 	// Clean up.
+	for (i = 0; i < nsubdirs; i++)
+		mem_free(subdirs[i]);
+	mem_free(subdirs);
 	closedir(dh);
+
+	return err;
+}
 #endif
 
-	return count;
+/**
+ * Puts a directory in the queue of a parallel listing and wakes up a walker
+ * to scan it.
+ *
+ * @param scan Parallel listing job.
+ * @param path Path to the directory.
+ * @param len  Length of the path.
+ */
+void queue_directory(dirscan_t *scan, const char *path, const size_t len) {
+	dirscan_dir_t *dir;
+
+	dir = (dirscan_dir_t*)mem_malloc(sizeof(dirscan_dir_t));
+	dir->path = (char*)mem_malloc((len + 1) * sizeof(char));
+	memcpy(dir->path, path, len);
+	dir->path[len] = '\0';
+
+	mutex_lock(&scan->lock);
+	dir->next = scan->queue;
+	scan->queue = dir;
+	scan->pending++;
+	mutex_unlock(&scan->lock);
+
+	semaphore_post(&scan->ready, 1);
+}
+
+/**
+ * Keeps scanning the directories of a parallel listing as they are queued
+ * until the whole tree has been gone through.
+ *
+ * @param arg  Parallel listing job.
+ * @param item Walker number, which picks the listing that gets the files.
+ */
+void walk_directories(void *arg, const size_t item) {
+	dirscan_t *scan = (dirscan_t*)arg;
+	char path[UKI_MAX_PATH];
+	dirscan_dir_t *dir;
+	ssize_t err;
+	bool done;
+#ifdef UNIX
+	int fd;
+#endif
+
+	for (;;) {
+		// Wait for a directory to scan or for the walk to be over.
+		semaphore_wait(&scan->ready);
+		mutex_lock(&scan->lock);
+		dir = scan->queue;
+		if (dir != NULL)
+			scan->queue = dir->next;
+		err = scan->err;
+		mutex_unlock(&scan->lock);
+		if (dir == NULL)
+			break;
+
+		// Scan it, unless the listing already failed anyway.
+		if (err == UKI_OK) {
+			strcpy(path, dir->path);
+#ifdef WINDOWS
+			err = scan_directory(&scan->lists[item], &scan->capacities[item],
+								 path, true, scan);
+#else
+			fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd < 0) {
+				err = UKI_ERROR_DIRLIST_NOTFOUND;
+			} else {
+				err = scan_directory(&scan->lists[item],
+									 &scan->capacities[item], fd, path,
+									 strlen(path), true, scan);
+			}
+#endif
+		}
+		mem_free(dir->path);
+		mem_free(dir);
+
+		// Release everyone once the last directory has been scanned.
+		mutex_lock(&scan->lock);
+		if ((err < 0) && (scan->err == UKI_OK))
+			scan->err = err;
+		done = (--scan->pending == 0);
+		mutex_unlock(&scan->lock);
+		if (done)
+			semaphore_post(&scan->ready, scan->nwalkers);
+	}
 }
 
 /**
@@ -521,41 +1057,268 @@ long file_contents_size(const char *fname) {
  *                  of error.
  */
 size_t slurp_file(char **contents, const char *fname) {
+	return slurp_file_info(contents, NULL, fname);
+}
+
+/**
+ * Reads a whole file into a string, opening it only once, and gets the
+ * metadata of what was read.
+ *
+ * @param  contents String where the file contents are to be stored (will be
+ *                  allocated by this function).
+ * @param  info     File metadata at the time it was read. (Can be NULL)
+ * @param  fname    File path.
+ * @return          Size of the contents string. Sets contents to NULL in case
+ *                  of error.
+ */
+size_t slurp_file_info(char **contents, file_info_t *info, const char *fname) {
+#ifdef WINDOWS
 	FILE *fh;
 	long fsize;
 	size_t nread;
 
-	// Get file size and allocate memory for it.
-	fsize = file_contents_size(fname);
-	if (fsize >= 0L) {
-		*contents = (char*)malloc((fsize + 1) * sizeof(char));
-	} else {
-		*contents = NULL;
+	// Get the metadata before reading so that a change in between is caught.
+	*contents = NULL;
+	if ((info != NULL) && !file_info(info, fname))
 		return 0;
-	}
 
-	// Handle empty files.
-	if (fsize == 0L) {
-		*contents[0] = '\0';
-		return 0;
-	}
-
-	// Open file to read its contents.
+	// Open the file and seek it to determine its size.
 	fh = fopen(fname, "r");
-	if (fh == NULL) {
-		*contents = NULL;
+	if (fh == NULL)
+		return 0;
+	fseek(fh, 0L, SEEK_END);
+	fsize = ftell(fh);
+	fseek(fh, 0L, SEEK_SET);
+	if (fsize < 0L) {
+		fclose(fh);
 		return 0;
 	}
 
 	// Reads the whole file into the buffer and close it.
+	*contents = (char*)mem_malloc((fsize + 1) * sizeof(char));
 	nread = fread(*contents, sizeof(char), fsize, fh);
 	fclose(fh);
+#else
+	struct stat st;
+	size_t nread;
+	int fd;
+
+	// Open the file and get its size.
+	*contents = NULL;
+	if ((fd = open(fname, O_RDONLY)) < 0)
+		return 0;
+	if ((fstat(fd, &st) != 0) || S_ISDIR(st.st_mode)) {
+		close(fd);
+		return 0;
+	}
+	if (info != NULL)
+		stat_file_info(info, &st);
+
+	// Reads the whole file into the buffer and close it.
+	*contents = (char*)mem_malloc(((size_t)st.st_size + 1) * sizeof(char));
+	nread = read_fd(fd, *contents, (size_t)st.st_size);
+	close(fd);
+#endif
 
 	// Make sure our string is properly terminated and return.
 	(*contents)[nread] = '\0';
 	return nread;
 }
 
+/**
+ * Opens a read-only view of the whole contents of a file, opening it only
+ * once. Big files are mapped into memory instead of being copied, while small
+ * ones are just read, since that's cheaper than setting up a mapping.
+ * @remark The view contents are not NULL terminated.
+ *
+ * @param  view  File view structure to be populated, including the metadata
+ *               of the file at the time it was opened.
+ * @param  fname File path.
+ * @return       TRUE if the file could be read.
+ */
+bool open_file_view(file_view_t *view, const char *fname) {
+#ifdef WINDOWS
+	// Just slurp the file.
+	view->size = slurp_file_info(&view->buf, &view->info, fname);
+	view->data = view->buf;
+
+	return view->buf != NULL;
+#else
+	struct stat st;
+	void *map;
+	int fd;
+
+	view->buf = NULL;
+
+	// Open the file and get its size.
+	if ((fd = open(fname, O_RDONLY)) < 0)
+		return false;
+	if ((fstat(fd, &st) != 0) || S_ISDIR(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+	stat_file_info(&view->info, &st);
+
+	// Handle empty files.
+	view->size = (size_t)st.st_size;
+	if (view->size == 0) {
+		close(fd);
+		view->data = "";
+
+		return true;
+	}
+
+	// Small files are read straight into a buffer.
+	if (view->size < FILE_VIEW_MAP_MIN) {
+		view->buf = (char*)mem_malloc(view->size);
+		view->size = read_fd(fd, view->buf, view->size);
+		view->data = view->buf;
+		close(fd);
+
+		return true;
+	}
+
+	// Map the file into memory.
+	map = mmap(NULL, view->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	view->data = (const char*)map;
+	return true;
+#endif
+}
+
+/**
+ * Closes a file view.
+ *
+ * @param view File view to be closed.
+ */
+void close_file_view(file_view_t *view) {
+#ifdef WINDOWS
+	mem_free(view->buf);
+#else
+	if (view->buf != NULL) {
+		mem_free(view->buf);
+	} else if (view->size > 0) {
+		munmap((void*)view->data, view->size);
+	}
+#endif
+
+	view->data = NULL;
+	view->buf = NULL;
+	view->size = 0;
+}
+
+/**
+ * Writes a whole string to a file, replacing whatever was there.
+ *
+ * @param  fname    File path.
+ * @param  contents Contents to be written.
+ * @param  len      Length of the contents.
+ * @return          TRUE if the whole contents were written.
+ */
+bool write_file(const char *fname, const char *contents, const size_t len) {
+	FILE *fh;
+	size_t nwritten;
+
+	// Open the file for writing.
+	fh = fopen(fname, "wb");
+	if (fh == NULL)
+		return false;
+
+	// Write everything and close it.
+	nwritten = fwrite(contents, sizeof(char), len, fh);
+	if (fclose(fh) != 0)
+		return false;
+
+	return nwritten == len;
+}
+
+/**
+ * Copies a file, replacing the destination if it already exists.
+ *
+ * @param  dest Destination file path.
+ * @param  src  Source file path.
+ * @return      TRUE if the file was copied successfully.
+ */
+bool copy_file(const char *dest, const char *src) {
+	FILE *in;
+	FILE *out;
+	char buf[4096];
+	size_t nread;
+	bool ok = true;
+
+	// Open both files.
+	if ((in = fopen(src, "rb")) == NULL)
+		return false;
+	if ((out = fopen(dest, "wb")) == NULL) {
+		fclose(in);
+		return false;
+	}
+
+	// Copy the contents over in chunks.
+	while ((nread = fread(buf, sizeof(char), sizeof(buf), in)) > 0) {
+		if (fwrite(buf, sizeof(char), nread, out) != nread) {
+			ok = false;
+			break;
+		}
+	}
+
+	// Check for errors and clean up.
+	if (ferror(in))
+		ok = false;
+	fclose(in);
+	if (fclose(out) != 0)
+		ok = false;
+
+	return ok;
+}
+
+/**
+ * Creates all of the folders leading up to a file, if they don't exist yet.
+ *
+ * @param  fpath File path.
+ * @return       TRUE if the folders exist when we are done.
+ */
+bool create_parent_dirs(const char *fpath) {
+	char path[UKI_MAX_PATH];
+	char *tmp;
+#ifdef WINDOWS
+	WCHAR szPath[UKI_MAX_PATH];
+#endif
+
+	strncpy(path, fpath, UKI_MAX_PATH - 1);
+	path[UKI_MAX_PATH - 1] = '\0';
+
+	// Create each folder along the way, skipping the root.
+	for (tmp = path + 1; *tmp != '\0'; tmp++) {
+#ifdef WINDOWS
+		if ((*tmp != '\\') && (*tmp != '/'))
+			continue;
+#else
+		if (*tmp != '/')
+			continue;
+#endif
+
+		*tmp = '\0';
+#ifdef WINDOWS
+		if (!StringAtoW(szPath, path))
+			return false;
+		if (!CreateDirectory(szPath, NULL) &&
+				(GetLastError() != ERROR_ALREADY_EXISTS))
+			return false;
+		*tmp = '\\';
+#else
+		if ((mkdir(path, 0755) != 0) && (errno != EEXIST))
+			return false;
+		*tmp = '/';
+#endif
+	}
+
+	return true;
+}
+
 /**
  * Checks if a file extension is the same as the one specified.
  *
@@ -609,6 +1372,138 @@ bool file_exists(const char *fpath) {
 #endif
 }
 
+/**
+ * Gets the metadata of a file.
+ *
+ * @param  info  File metadata structure to be populated.
+ * @param  fpath File path to be checked.
+ * @return       TRUE if the file exists and its metadata was retrieved.
+ */
+bool file_info(file_info_t *info, const char *fpath) {
+#ifdef WINDOWS
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	WCHAR szPath[UKI_MAX_PATH];
+
+	// Convert path string to Unicode.
+	if (!StringAtoW(szPath, fpath))
+		return false;
+
+	// Get the file attributes.
+	if (!GetFileAttributesEx(szPath, GetFileExInfoStandard, &attr))
+		return false;
+	if (attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		return false;
+
+	filetime_info(info, &attr.ftLastWriteTime, attr.nFileSizeLow);
+#else
+	struct stat st;
+
+	// Get the file status.
+	if (stat(fpath, &st) != 0)
+		return false;
+	if (S_ISDIR(st.st_mode))
+		return false;
+
+	stat_file_info(info, &st);
+#endif
+
+	return true;
+}
+
+#ifdef WINDOWS
+/**
+ * Populates a file metadata structure from what Windows tells us about a file.
+ *
+ * @param info  File metadata structure to be populated.
+ * @param ftime Last write time of the file.
+ * @param size  Size of the file.
+ */
+void filetime_info(file_info_t *info, const FILETIME *ftime, const DWORD size) {
+	ULARGE_INTEGER qtime;
+
+	// Convert the file time (100ns intervals since 1601) to UNIX time.
+	qtime.LowPart = ftime->dwLowDateTime;
+	qtime.HighPart = ftime->dwHighDateTime;
+	info->size = (size_t)size;
+	info->mtime = (time_t)((qtime.QuadPart / 10000000) - 11644473600);
+	info->mtime_nsec = (long)((qtime.QuadPart % 10000000) * 100);
+
+	// Only a file handle can tell us its file index.
+	info->inode = 0;
+}
+#else
+/**
+ * Populates a file metadata structure from the status of a file.
+ *
+ * @param info File metadata structure to be populated.
+ * @param st   File status.
+ */
+void stat_file_info(file_info_t *info, const struct stat *st) {
+	info->size = (size_t)st->st_size;
+	info->mtime = st->st_mtime;
+#if defined(__APPLE__) && defined(__MACH__)
+	info->mtime_nsec = st->st_mtimespec.tv_nsec;
+#else
+	info->mtime_nsec = st->st_mtim.tv_nsec;
+#endif
+	info->inode = st->st_ino;
+}
+
+/**
+ * Reads from a file descriptor until a buffer is full or the file ends.
+ *
+ * @param  fd   File descriptor.
+ * @param  buf  Buffer to read into.
+ * @param  size Number of bytes to read.
+ * @return      Number of bytes actually read.
+ */
+size_t read_fd(int fd, char *buf, const size_t size) {
+	size_t nread = 0;
+	ssize_t n;
+
+	while (nread < size) {
+		n = read(fd, buf + nread, size - nread);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		} else if (n == 0) {
+			break;
+		}
+
+		nread += (size_t)n;
+	}
+
+	return nread;
+}
+#endif
+
+/**
+ * Checks if a file has changed between two metadata snapshots.
+ *
+ * @param  a First file metadata structure.
+ * @param  b Second file metadata structure.
+ * @return   TRUE if the size, the modification time or the inode differ.
+ *           (Inodes are only compared if both of them are known)
+ */
+bool file_info_changed(const file_info_t a, const file_info_t b) {
+	return (a.size != b.size) || (a.mtime != b.mtime) ||
+		(a.mtime_nsec != b.mtime_nsec) ||
+		((a.inode != 0) && (b.inode != 0) && (a.inode != b.inode));
+}
+
+/**
+ * Checks if a file was modified after another one.
+ *
+ * @param  a First file metadata structure.
+ * @param  b Second file metadata structure.
+ * @return   TRUE if the first file is newer than the second.
+ */
+bool file_info_newer(const file_info_t a, const file_info_t b) {
+	return (a.mtime > b.mtime) ||
+		((a.mtime == b.mtime) && (a.mtime_nsec > b.mtime_nsec));
+}
+
 /**
  * Frees a directory listing structure.
  *
@@ -617,10 +1512,12 @@ bool file_exists(const char *fpath) {
 void free_dirlist(dirlist_t list) {
 	size_t i;
 	for (i = 0; i < list.size; i++) {
-		free(list.list[i]);
+		mem_free(list.list[i]);
 	}
 
-	free(list.list);
+	mem_free(list.list);
+	mem_free(list.info);
+	mem_free(list.runs);
 }
 
 /**
@@ -646,24 +1543,39 @@ int path_deepness(const char *path) {
 }
 
 /**
- * A sorting function to sort directories to be used with qsort. Prioritizing
- * directories.
+ * A sorting function to sort the directories of a listing to be used with
+ * qsort. Prioritizing the deepest ones.
+ *
+ * @param  a First parameter to sort.
+ * @param  b Next parameter to sort.
+ * @return   qsort decision integer.
+ */
+#ifdef WINDOWS
+int __cdecl sort_runs_ascending(const void *a, const void *b) {
+#else
+int sort_runs_ascending(const void *a, const void *b) {
+#endif
+	const dirlist_run_t *ra = (const dirlist_run_t*)a;
+	const dirlist_run_t *rb = (const dirlist_run_t*)b;
+	int dr = rb->deepness - ra->deepness;
+
+	// Directories as deep as each other differ somewhere before the file names.
+	return dr ? dr : strcmp(ra->sample, rb->sample);
+}
+
+/**
+ * A sorting function to sort the files of a single directory by name to be
+ * used with qsort.
  *
  * @param  a First parameter to sort.
  * @param  b Next parameter to sort.
  * @return   qsort decision integer.
  */
 #ifdef WINDOWS
-int __cdecl sort_dirs_ascending (const void *a, const void *b) {
+int __cdecl sort_entries_ascending(const void *a, const void *b) {
 #else
-int sort_dirs_ascending (const void *a, const void *b) {
+int sort_entries_ascending(const void *a, const void *b) {
 #endif
-    const char *pa = *(char *const *)a;
-    const char *pb = *(char *const *)b;
-	int da = path_deepness(pa);
-	int db = path_deepness(pb);
-	int dr = db - da;
-
-	// Don't ask me about this. It just works.
-    return dr ? dr : strcmp(pa, pb);
+	return strcmp(((const dirlist_entry_t*)a)->name,
+				  ((const dirlist_entry_t*)b)->name);
 }
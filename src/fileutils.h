@@ -10,21 +10,61 @@
 
 #include "windowshelper.h"
 #include "constants.h"
+#include "strutils.h"
 #ifdef UNIX
 #include <sys/types.h>
 #include <stddef.h>
 #include <stdbool.h>
 #endif
+#include <time.h>
+
+// File serial number type.
+#ifdef WINDOWS
+typedef ULONGLONG file_id_t;
+#else
+typedef ino_t file_id_t;
+#endif
+
+// File metadata structure. (A zero inode means it isn't known)
+typedef struct {
+	size_t size;
+	time_t mtime;
+	long   mtime_nsec;
+	file_id_t inode;
+} file_info_t;
+
+// Read-only view of a file's contents.
+typedef struct {
+	const char *data;
+	size_t size;
+	char *buf;
+	file_info_t info;
+} file_view_t;
+
+// Files of a single directory inside a listing.
+typedef struct {
+	size_t start;
+	size_t count;
+	size_t prefix;
+	int deepness;
+	const char *sample;
+} dirlist_run_t;
 
 // Directory listing container.
 typedef struct {
 	size_t  size;
 	char   **list;
+	file_info_t *info;
+	size_t nruns;
+	dirlist_run_t *runs;
 } dirlist_t;
 
 // Checking.
 bool file_exists(const char *fpath);
 bool file_ext_match(const char *fpath, const char *ext);
+bool file_info(file_info_t *info, const char *fpath);
+bool file_info_changed(const file_info_t a, const file_info_t b);
+bool file_info_newer(const file_info_t a, const file_info_t b);
 
 // Path manipulaton.
 size_t cleanup_path(char *path);
@@ -39,10 +79,20 @@ int path_deepness(const char *path);
 void sort_dirlist(dirlist_t *list);
 ssize_t list_directory_files(dirlist_t *list, const char *path,
 							 const bool recursive);
+ssize_t list_directory_files_parallel(dirlist_t *list, const char *path,
+									  const size_t nthreads);
 
 // File content.
 long file_contents_size(const char *fname);
 size_t slurp_file(char **contents, const char *fname);
+size_t slurp_file_info(char **contents, file_info_t *info, const char *fname);
+bool open_file_view(file_view_t *view, const char *fname);
+void close_file_view(file_view_t *view);
+bool write_file(const char *fname, const char *contents, const size_t len);
+bool copy_file(const char *dest, const char *src);
+bool create_parent_dirs(const char *fpath);
 uki_error substitute_assets(char **html, const int deepness);
+void render_assets(strbuf_t *out, const char *html, const size_t len,
+				   const int deepness);
 
 #endif /* _FILEUTILS_H_ */
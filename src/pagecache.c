@@ -0,0 +1,562 @@
+/**
+ * pagecache.c
+ * A memory budgeted cache of fully rendered pages.
+ *
+ * Pages are kept in a hash table keyed by their path and in a list ordered by
+ * how recently they were used, so that the least recently used ones can be
+ * evicted once the cache goes over its budget. Entries never change once they
+ * are in the cache: evicted or invalidated entries are retired into the
+ * reclamation domain, so the rendered contents of a page can be handed out
+ * without copying them for as long as the reader stays in a read section.
+ *
+ * Renders of pages that aren't in the cache can be coalesced: the first one
+ * to ask for a page renders it, while everyone else asking for it in the
+ * meantime waits for that render and gets the same entry.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#include "pagecache.h"
+#include "strutils.h"
+#include "allocator.h"
+#include <string.h>
+
+// Initial number of hash table buckets.
+#define PAGE_CACHE_BUCKETS 64
+
+// Private methods.
+void link_entry(page_cache_t *cache, page_cache_entry_t *entry);
+void unlink_entry(page_cache_t *cache, page_cache_entry_t *entry);
+void evict_entries(page_cache_t *cache, const size_t budget);
+void grow_buckets(page_cache_t *cache);
+void release_flight(page_cache_t *cache, page_cache_flight_t *flight);
+
+/**
+ * Initializes a page cache. It starts out disabled, with a budget of zero.
+ *
+ * @param cache   Page cache.
+ * @param reclaim Reclamation domain the evicted pages are retired into.
+ */
+void page_cache_init(page_cache_t *cache, epoch_domain_t *reclaim) {
+	cache->budget = 0;
+	cache->used = 0;
+	cache->generation = 0;
+	cache->compress = false;
+	cache->count = 0;
+	cache->nbuckets = PAGE_CACHE_BUCKETS;
+	cache->buckets = (page_cache_entry_t**)mem_calloc(PAGE_CACHE_BUCKETS,
+		sizeof(page_cache_entry_t*));
+	cache->head = NULL;
+	cache->tail = NULL;
+	cache->flights = NULL;
+	cache->reclaim = reclaim;
+	mutex_init(&cache->lock);
+}
+
+/**
+ * Frees every page in the cache and the cache itself.
+ * @remark There must be no readers left when this is called.
+ *
+ * @param cache Page cache.
+ */
+void page_cache_destroy(page_cache_t *cache) {
+	page_cache_entry_t *entry;
+	page_cache_entry_t *next;
+
+	for (entry = cache->head; entry != NULL; entry = next) {
+		next = entry->next;
+		destroy_page_cache_entry(entry);
+	}
+
+	mem_free(cache->buckets);
+	cache->buckets = NULL;
+	cache->head = NULL;
+	cache->tail = NULL;
+	cache->count = 0;
+	cache->used = 0;
+	mutex_destroy(&cache->lock);
+}
+
+/**
+ * Sets how much memory the cache may use, evicting the least recently used
+ * pages until it fits.
+ *
+ * @param cache  Page cache.
+ * @param budget Memory budget in bytes. (0 disables the cache)
+ */
+void page_cache_budget(page_cache_t *cache, const size_t budget) {
+	mutex_lock(&cache->lock);
+	cache->budget = budget;
+	evict_entries(cache, budget);
+	mutex_unlock(&cache->lock);
+}
+
+/**
+ * Checks if the cache has any memory to hold pages in.
+ *
+ * @param  cache Page cache.
+ * @return       TRUE if the budget isn't zero.
+ */
+bool page_cache_enabled(page_cache_t *cache) {
+	bool enabled;
+
+	mutex_lock(&cache->lock);
+	enabled = cache->budget > 0;
+	mutex_unlock(&cache->lock);
+
+	return enabled;
+}
+
+/**
+ * Throws away every page in the cache, including the ones that are still being
+ * rendered.
+ *
+ * @param cache Page cache.
+ */
+void page_cache_flush(page_cache_t *cache) {
+	mutex_lock(&cache->lock);
+	sync_add(&cache->generation, 1);
+	evict_entries(cache, 0);
+	mutex_unlock(&cache->lock);
+}
+
+/**
+ * Sets whether the pages should also be kept compressed, throwing away the
+ * ones that were cached without it.
+ *
+ * @param cache   Page cache.
+ * @param enabled Should the pages be compressed?
+ */
+void page_cache_compress(page_cache_t *cache, const bool enabled) {
+	sync_store(&cache->compress, enabled);
+	page_cache_flush(cache);
+}
+
+/**
+ * Creates a new page cache entry that still has to be populated.
+ * @remark Entries created before the cache is flushed won't be inserted.
+ *
+ * @param  cache Page cache the entry is going into.
+ * @param  page  Path of the page the entry is for.
+ * @return       New page cache entry.
+ */
+page_cache_entry_t* page_cache_entry(page_cache_t *cache, const char *page) {
+	page_cache_entry_t *entry;
+
+	entry = (page_cache_entry_t*)mem_calloc(1, sizeof(page_cache_entry_t));
+	entry->page = (char*)mem_malloc((strlen(page) + 1) * sizeof(char));
+	strcpy(entry->page, page);
+	entry->hash = strhash(page);
+	entry->generation = sync_load(&cache->generation);
+
+	return entry;
+}
+
+/**
+ * Records a file a cached page was rendered from, along with its current
+ * metadata.
+ * @remark Dependencies should be recorded before the page is rendered, so
+ *         that a change in the middle of the render invalidates the page.
+ *
+ * @param  entry Page cache entry.
+ * @param  fpath Path to the file the page depends on.
+ * @return       TRUE if the file exists.
+ */
+bool page_cache_entry_dep(page_cache_entry_t *entry, const char *fpath) {
+	file_info_t info;
+
+	if (!file_info(&info, fpath))
+		return false;
+
+	entry->deps = mem_realloc(entry->deps, sizeof(char*) * (entry->ndeps + 1));
+	entry->deps_info = mem_realloc(entry->deps_info, sizeof(file_info_t) *
+								   (entry->ndeps + 1));
+	entry->deps[entry->ndeps] = (char*)mem_malloc((strlen(fpath) + 1) *
+												  sizeof(char));
+	strcpy(entry->deps[entry->ndeps], fpath);
+	entry->deps_info[entry->ndeps++] = info;
+
+	return true;
+}
+
+/**
+ * Checks if none of the files a cached page was rendered from have changed.
+ *
+ * @param  entry Page cache entry.
+ * @return       TRUE if the cached page is still good.
+ */
+bool page_cache_entry_valid(const page_cache_entry_t *entry) {
+	file_info_t info;
+	size_t i;
+
+	for (i = 0; i < entry->ndeps; i++) {
+		if (!file_info(&info, entry->deps[i]) ||
+				file_info_changed(info, entry->deps_info[i]))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Frees a page cache entry.
+ *
+ * @param entry Page cache entry to be freed. (Can be NULL)
+ */
+void destroy_page_cache_entry(void *entry) {
+	page_cache_entry_t *ent = (page_cache_entry_t*)entry;
+	size_t i;
+
+	if (ent == NULL)
+		return;
+
+	for (i = 0; i < ent->ndeps; i++)
+		mem_free(ent->deps[i]);
+	mem_free(ent->deps);
+	mem_free(ent->deps_info);
+	mem_free(ent->data);
+	mem_free(ent->gzip);
+	mem_free(ent->page);
+	mem_free(ent);
+}
+
+/**
+ * Looks for a page in the cache and marks it as the most recently used.
+ * @remark Must be called inside a read section of the cache's reclamation
+ *         domain, since that's what keeps the entry alive.
+ *
+ * @param  cache Page cache.
+ * @param  page  Path of the page.
+ * @return       Cached page or NULL if it isn't in the cache.
+ */
+page_cache_entry_t* page_cache_find(page_cache_t *cache, const char *page) {
+	page_cache_entry_t *entry;
+	unsigned long hash;
+
+	hash = strhash(page);
+	mutex_lock(&cache->lock);
+	for (entry = cache->buckets[hash % cache->nbuckets]; entry != NULL;
+			entry = entry->chain) {
+		if ((entry->hash == hash) && (strcmp(entry->page, page) == 0))
+			break;
+	}
+
+	// Move it to the front of the line.
+	if (entry != NULL) {
+		unlink_entry(cache, entry);
+		link_entry(cache, entry);
+	}
+	mutex_unlock(&cache->lock);
+
+	return entry;
+}
+
+/**
+ * Takes a snapshot of every page that is in the cache.
+ * @remark Must be called inside a read section of the cache's reclamation
+ *         domain, since that's what keeps the entries alive.
+ *
+ * @param  cache   Page cache.
+ * @param  entries Pages in the cache. (Free the array with mem_free())
+ * @return         Number of pages in the cache.
+ */
+size_t page_cache_entries(page_cache_t *cache, page_cache_entry_t ***entries) {
+	page_cache_entry_t *entry;
+	size_t n = 0;
+
+	mutex_lock(&cache->lock);
+	*entries = (page_cache_entry_t**)mem_malloc(sizeof(page_cache_entry_t*) *
+		((cache->count > 0) ? cache->count : 1));
+	for (entry = cache->head; entry != NULL; entry = entry->next)
+		(*entries)[n++] = entry;
+	mutex_unlock(&cache->lock);
+
+	return n;
+}
+
+/**
+ * Inserts a populated page into the cache, replacing any older version of it
+ * and evicting the least recently used pages to make room for it.
+ *
+ * @param  cache Page cache.
+ * @param  entry Page cache entry. (Owned by the cache if inserted)
+ * @return       TRUE if the page was inserted. FALSE if it doesn't fit or the
+ *               cache was flushed since it was created, in which case it's
+ *               still owned by the caller.
+ */
+bool page_cache_insert(page_cache_t *cache, page_cache_entry_t *entry) {
+	page_cache_entry_t *old;
+	size_t i;
+
+	// Work out how much memory the entry takes up.
+	entry->cost = sizeof(page_cache_entry_t) + strlen(entry->page) + 1 +
+		entry->len + 1 + entry->gzip_len +
+		((sizeof(char*) + sizeof(file_info_t)) * entry->ndeps);
+	for (i = 0; i < entry->ndeps; i++)
+		entry->cost += strlen(entry->deps[i]) + 1;
+
+	mutex_lock(&cache->lock);
+	if ((entry->cost > cache->budget) ||
+			(entry->generation != cache->generation)) {
+		mutex_unlock(&cache->lock);
+		return false;
+	}
+
+	// Get rid of the older version of the page.
+	for (old = cache->buckets[entry->hash % cache->nbuckets]; old != NULL;
+			old = old->chain) {
+		if ((old->hash == entry->hash) && (strcmp(old->page, entry->page) == 0))
+			break;
+	}
+	if (old != NULL) {
+		unlink_entry(cache, old);
+		epoch_retire(cache->reclaim, old, destroy_page_cache_entry);
+	}
+
+	// Make room for it and put it in.
+	evict_entries(cache, cache->budget - entry->cost);
+	if (cache->count >= cache->nbuckets)
+		grow_buckets(cache);
+	link_entry(cache, entry);
+	mutex_unlock(&cache->lock);
+
+	return true;
+}
+
+/**
+ * Removes a page from the cache if it's still there.
+ *
+ * @param cache Page cache.
+ * @param entry Page cache entry found with page_cache_find().
+ */
+void page_cache_remove(page_cache_t *cache, page_cache_entry_t *entry) {
+	page_cache_entry_t *found;
+
+	// Someone else might have already replaced it.
+	mutex_lock(&cache->lock);
+	for (found = cache->buckets[entry->hash % cache->nbuckets]; found != NULL;
+			found = found->chain) {
+		if (found == entry)
+			break;
+	}
+	if (found != NULL) {
+		unlink_entry(cache, entry);
+		epoch_retire(cache->reclaim, entry, destroy_page_cache_entry);
+	}
+	mutex_unlock(&cache->lock);
+}
+
+/**
+ * Joins the render of a page that's already in progress or starts a new one
+ * that others can join.
+ *
+ * @param  cache  Page cache.
+ * @param  page   Path of the page.
+ * @param  leader Set to TRUE if the caller has to render the page and land it
+ *                with page_cache_land(), FALSE if it has to wait for it with
+ *                page_cache_wait().
+ * @return        Render in progress.
+ */
+page_cache_flight_t* page_cache_takeoff(page_cache_t *cache, const char *page,
+										bool *leader) {
+	page_cache_flight_t *flight;
+	unsigned long hash;
+
+	hash = strhash(page);
+	mutex_lock(&cache->lock);
+	for (flight = cache->flights; flight != NULL; flight = flight->next) {
+		if ((flight->hash == hash) && (strcmp(flight->page, page) == 0))
+			break;
+	}
+
+	if (flight != NULL) {
+		// Someone is already on it.
+		flight->refs++;
+		*leader = false;
+	} else {
+		// We'll be the ones rendering it.
+		flight = (page_cache_flight_t*)mem_calloc(1,
+			sizeof(page_cache_flight_t));
+		flight->page = (char*)mem_malloc((strlen(page) + 1) * sizeof(char));
+		strcpy(flight->page, page);
+		flight->hash = hash;
+		flight->refs = 1;
+		semaphore_init(&flight->landed);
+		flight->next = cache->flights;
+		cache->flights = flight;
+		*leader = true;
+	}
+	mutex_unlock(&cache->lock);
+
+	return flight;
+}
+
+/**
+ * Hands the result of a render over to everyone waiting for it. Anyone who
+ * asks for the page after this has to look it up again.
+ * @remark The entry must not have been inserted into the cache or retired yet.
+ *         Waiters entered their read sections before joining, so only doing
+ *         that after landing keeps the entry alive for all of them.
+ *
+ * @param cache  Page cache.
+ * @param flight Render started by the caller with page_cache_takeoff().
+ * @param entry  Rendered page or NULL if it failed.
+ * @param err    Result of the render.
+ */
+void page_cache_land(page_cache_t *cache, page_cache_flight_t *flight,
+					 page_cache_entry_t *entry, const uki_error err) {
+	page_cache_flight_t **link;
+
+	mutex_lock(&cache->lock);
+	link = &cache->flights;
+	while (*link != flight)
+		link = &(*link)->next;
+	*link = flight->next;
+
+	// Wake up everyone who joined in.
+	flight->entry = entry;
+	flight->err = err;
+	if (flight->refs > 1)
+		semaphore_post(&flight->landed, flight->refs - 1);
+	mutex_unlock(&cache->lock);
+
+	release_flight(cache, flight);
+}
+
+/**
+ * Waits for the render of a page started by someone else.
+ * @remark Must be called inside a read section of the cache's reclamation
+ *         domain, entered before joining the render.
+ *
+ * @param  cache  Page cache.
+ * @param  flight Render joined with page_cache_takeoff().
+ * @param  err    Result of the render.
+ * @return        Rendered page or NULL if the render failed.
+ */
+page_cache_entry_t* page_cache_wait(page_cache_t *cache,
+									page_cache_flight_t *flight,
+									uki_error *err) {
+	page_cache_entry_t *entry;
+
+	semaphore_wait(&flight->landed);
+	entry = flight->entry;
+	*err = flight->err;
+	release_flight(cache, flight);
+
+	return entry;
+}
+
+/**
+ * Drops a reference to a render, freeing it if it was the last one.
+ *
+ * @param cache  Page cache.
+ * @param flight Render that has landed.
+ */
+void release_flight(page_cache_t *cache, page_cache_flight_t *flight) {
+	size_t refs;
+
+	mutex_lock(&cache->lock);
+	refs = --flight->refs;
+	mutex_unlock(&cache->lock);
+
+	if (refs == 0) {
+		semaphore_destroy(&flight->landed);
+		mem_free(flight->page);
+		mem_free(flight);
+	}
+}
+
+/**
+ * Links an entry into the hash table and the front of the recently used list.
+ * @remark The cache must be locked.
+ *
+ * @param cache Page cache.
+ * @param entry Page cache entry.
+ */
+void link_entry(page_cache_t *cache, page_cache_entry_t *entry) {
+	size_t bucket = entry->hash % cache->nbuckets;
+
+	entry->chain = cache->buckets[bucket];
+	cache->buckets[bucket] = entry;
+
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if (cache->head != NULL)
+		cache->head->prev = entry;
+	cache->head = entry;
+	if (cache->tail == NULL)
+		cache->tail = entry;
+
+	cache->count++;
+	cache->used += entry->cost;
+}
+
+/**
+ * Unlinks an entry from the hash table and the recently used list.
+ * @remark The cache must be locked.
+ *
+ * @param cache Page cache.
+ * @param entry Page cache entry.
+ */
+void unlink_entry(page_cache_t *cache, page_cache_entry_t *entry) {
+	page_cache_entry_t **link;
+
+	link = &cache->buckets[entry->hash % cache->nbuckets];
+	while (*link != entry)
+		link = &(*link)->chain;
+	*link = entry->chain;
+
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+
+	cache->count--;
+	cache->used -= entry->cost;
+}
+
+/**
+ * Evicts the least recently used pages until the cache fits a budget.
+ * @remark The cache must be locked.
+ *
+ * @param cache  Page cache.
+ * @param budget Memory budget to fit into.
+ */
+void evict_entries(page_cache_t *cache, const size_t budget) {
+	page_cache_entry_t *entry;
+
+	while ((cache->used > budget) && (cache->tail != NULL)) {
+		entry = cache->tail;
+		unlink_entry(cache, entry);
+		epoch_retire(cache->reclaim, entry, destroy_page_cache_entry);
+	}
+}
+
+/**
+ * Doubles the number of buckets in the hash table.
+ * @remark The cache must be locked.
+ *
+ * @param cache Page cache.
+ */
+void grow_buckets(page_cache_t *cache) {
+	page_cache_entry_t *entry;
+	size_t bucket;
+
+	mem_free(cache->buckets);
+	cache->nbuckets *= 2;
+	cache->buckets = (page_cache_entry_t**)mem_calloc(cache->nbuckets,
+		sizeof(page_cache_entry_t*));
+
+	// Put everything back in its new place.
+	for (entry = cache->head; entry != NULL; entry = entry->next) {
+		bucket = entry->hash % cache->nbuckets;
+		entry->chain = cache->buckets[bucket];
+		cache->buckets[bucket] = entry;
+	}
+}
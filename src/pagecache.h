@@ -0,0 +1,94 @@
+/**
+ * pagecache.h
+ * A memory budgeted cache of fully rendered pages.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+
+#include "windowshelper.h"
+#include "fileutils.h"
+#include "epoch.h"
+#include "sync.h"
+#include <stdlib.h>
+#ifdef UNIX
+#include <stdbool.h>
+#endif
+
+// Cached page. (Contents are immutable once inserted)
+typedef struct page_cache_entry_s {
+	char *page;
+	unsigned long hash;
+	unsigned long generation;
+	char *data;
+	size_t len;
+	char *gzip;
+	size_t gzip_len;
+	size_t cost;
+	size_t ndeps;
+	char **deps;
+	file_info_t *deps_info;
+	struct page_cache_entry_s *chain;
+	struct page_cache_entry_s *prev;
+	struct page_cache_entry_s *next;
+} page_cache_entry_t;
+
+// Render of a page that is in progress, which others can wait on.
+typedef struct page_cache_flight_s {
+	char *page;
+	unsigned long hash;
+	page_cache_entry_t *entry;
+	uki_error err;
+	size_t refs;
+	semaphore_t landed;
+	struct page_cache_flight_s *next;
+} page_cache_flight_t;
+
+// Page cache.
+typedef struct {
+	size_t budget;
+	size_t used;
+	unsigned long generation;
+	unsigned long compress;
+	size_t count;
+	size_t nbuckets;
+	page_cache_entry_t **buckets;
+	page_cache_entry_t *head;
+	page_cache_entry_t *tail;
+	page_cache_flight_t *flights;
+	epoch_domain_t *reclaim;
+	mutex_t lock;
+} page_cache_t;
+
+// Initialization and destruction.
+void page_cache_init(page_cache_t *cache, epoch_domain_t *reclaim);
+void page_cache_destroy(page_cache_t *cache);
+void page_cache_budget(page_cache_t *cache, const size_t budget);
+bool page_cache_enabled(page_cache_t *cache);
+void page_cache_flush(page_cache_t *cache);
+void page_cache_compress(page_cache_t *cache, const bool enabled);
+
+// Entries.
+page_cache_entry_t* page_cache_entry(page_cache_t *cache, const char *page);
+bool page_cache_entry_dep(page_cache_entry_t *entry, const char *fpath);
+bool page_cache_entry_valid(const page_cache_entry_t *entry);
+void destroy_page_cache_entry(void *entry);
+
+// Lookup.
+page_cache_entry_t* page_cache_find(page_cache_t *cache, const char *page);
+size_t page_cache_entries(page_cache_t *cache, page_cache_entry_t ***entries);
+bool page_cache_insert(page_cache_t *cache, page_cache_entry_t *entry);
+void page_cache_remove(page_cache_t *cache, page_cache_entry_t *entry);
+
+// Coalescing.
+page_cache_flight_t* page_cache_takeoff(page_cache_t *cache, const char *page,
+										bool *leader);
+void page_cache_land(page_cache_t *cache, page_cache_flight_t *flight,
+					 page_cache_entry_t *entry, const uki_error err);
+page_cache_entry_t* page_cache_wait(page_cache_t *cache,
+									page_cache_flight_t *flight,
+									uki_error *err);
+
+#endif /* _PAGECACHE_H_ */
@@ -0,0 +1,159 @@
+/**
+ * pool.c
+ * A fixed size pool of worker threads for spreading work across processors.
+ *
+ * Work is handed out as jobs made of a number of independent items. The
+ * workers, along with the thread that submitted the job, keep grabbing the
+ * next item with an atomic increment until there are none left.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#include "pool.h"
+#include "allocator.h"
+
+// Private methods.
+void pool_run_items(pool_t *pool);
+#ifdef WINDOWS
+DWORD WINAPI pool_worker(LPVOID arg);
+#else
+void* pool_worker(void *arg);
+#endif
+
+/**
+ * Initializes a worker pool and starts its threads.
+ *
+ * @param pool     Worker pool.
+ * @param nthreads Number of worker threads. The thread that runs a job also
+ *                 works on it, so 0 means jobs are run serially.
+ */
+void pool_init(pool_t *pool, const size_t nthreads) {
+	size_t i;
+
+	pool->nthreads = 0;
+	pool->threads = (thread_t*)mem_malloc(sizeof(thread_t) *
+										  ((nthreads > 0) ? nthreads : 1));
+	pool->quit = false;
+	pool->task = NULL;
+	pool->arg = NULL;
+	pool->count = 0;
+	pool->next = 0;
+	pool->active = 0;
+	semaphore_init(&pool->work);
+	semaphore_init(&pool->done);
+
+	// Start the workers, making do with what we've got if we can't get all.
+	for (i = 0; i < nthreads; i++) {
+#ifdef WINDOWS
+		pool->threads[i] = CreateThread(NULL, 0, pool_worker, pool, 0, NULL);
+		if (pool->threads[i] == NULL)
+			break;
+#else
+		if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0)
+			break;
+#endif
+
+		pool->nthreads++;
+	}
+}
+
+/**
+ * Stops the worker threads and frees the pool.
+ * @remark There must be no job running when this is called.
+ *
+ * @param pool Worker pool.
+ */
+void pool_destroy(pool_t *pool) {
+	size_t i;
+
+	// Wake everyone up and tell them to go home.
+	pool->quit = true;
+	if (pool->nthreads > 0)
+		semaphore_post(&pool->work, pool->nthreads);
+
+	for (i = 0; i < pool->nthreads; i++) {
+#ifdef WINDOWS
+		WaitForSingleObject(pool->threads[i], INFINITE);
+		CloseHandle(pool->threads[i]);
+#else
+		pthread_join(pool->threads[i], NULL);
+#endif
+	}
+
+	semaphore_destroy(&pool->work);
+	semaphore_destroy(&pool->done);
+	mem_free(pool->threads);
+	pool->threads = NULL;
+	pool->nthreads = 0;
+}
+
+/**
+ * Runs a task for every item of a job across the pool and waits for all of
+ * them to be done.
+ * @remark Only one job can be run in a pool at a time.
+ *
+ * @param pool  Worker pool.
+ * @param task  Task to be run for each item.
+ * @param arg   Argument passed to every task.
+ * @param count Number of items in the job.
+ */
+void pool_run(pool_t *pool, pool_task_t task, void *arg, const size_t count) {
+	if (count == 0)
+		return;
+
+	// Set up the job and wake the workers.
+	pool->task = task;
+	pool->arg = arg;
+	pool->count = (long)count;
+	sync_store(&pool->next, 0);
+	sync_store(&pool->active, (long)pool->nthreads);
+	if (pool->nthreads > 0)
+		semaphore_post(&pool->work, pool->nthreads);
+
+	// Lend a hand and wait for everyone to check in.
+	pool_run_items(pool);
+	if (pool->nthreads > 0)
+		semaphore_wait(&pool->done);
+
+	pool->task = NULL;
+	pool->arg = NULL;
+}
+
+/**
+ * Keeps running the items of the current job until there are none left.
+ *
+ * @param pool Worker pool.
+ */
+void pool_run_items(pool_t *pool) {
+	long item;
+
+	while ((item = sync_add(&pool->next, 1) - 1) < pool->count)
+		pool->task(pool->arg, (size_t)item);
+}
+
+/**
+ * Worker thread main loop.
+ *
+ * @param  arg Worker pool.
+ * @return     Nothing.
+ */
+#ifdef WINDOWS
+DWORD WINAPI pool_worker(LPVOID arg) {
+#else
+void* pool_worker(void *arg) {
+#endif
+	pool_t *pool = (pool_t*)arg;
+
+	for (;;) {
+		semaphore_wait(&pool->work);
+		if (pool->quit)
+			break;
+
+		// Work on the job and let the submitter know when everyone is done.
+		pool_run_items(pool);
+		if (sync_add(&pool->active, -1) == 0)
+			semaphore_post(&pool->done, 1);
+	}
+
+	return 0;
+}
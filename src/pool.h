@@ -0,0 +1,49 @@
+/**
+ * pool.h
+ * A fixed size pool of worker threads for spreading work across processors.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include "windowshelper.h"
+#include "sync.h"
+#include <stdlib.h>
+#ifdef UNIX
+#include <stdbool.h>
+#endif
+
+// Thread handle.
+#ifdef WINDOWS
+typedef HANDLE thread_t;
+#else
+typedef pthread_t thread_t;
+#endif
+
+// Task run for each item of a job.
+typedef void (*pool_task_t)(void *arg, const size_t item);
+
+// Worker pool structure.
+typedef struct {
+	size_t nthreads;
+	thread_t *threads;
+	semaphore_t work;
+	semaphore_t done;
+	bool quit;
+	pool_task_t task;
+	void *arg;
+	long count;
+	long next;
+	long active;
+} pool_t;
+
+// Initialization and destruction.
+void pool_init(pool_t *pool, const size_t nthreads);
+void pool_destroy(pool_t *pool);
+
+// Running.
+void pool_run(pool_t *pool, pool_task_t task, void *arg, const size_t count);
+
+#endif /* _POOL_H_ */
@@ -0,0 +1,648 @@
+/**
+ * shmcache.c
+ * A rendered pages cache in shared memory for sharing between processes.
+ *
+ * The cache lives in a file mapping (usually under /dev/shm) that every
+ * process serving the same wiki maps, so that a page rendered by any of them
+ * is available to all of them. The mapping is split into shards, each with its
+ * own process-shared lock, a small table of slots and a data area that works
+ * as a ring: new pages are written after the last one and whatever they land
+ * on is evicted, which makes the oldest pages the first to go.
+ *
+ * Pages are copied out of the mapping when they are found, since there is no
+ * way to know when another process is done with one. Every page carries a
+ * fingerprint of the settings it was rendered with, so processes only share
+ * pages if they agree on how they should look.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#include "shmcache.h"
+#include "strutils.h"
+#include "allocator.h"
+#include <string.h>
+#ifdef UNIX
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#endif
+
+#ifdef UNIX
+// Identification of the mapping layout.
+#define SHM_CACHE_MAGIC   0x756B6943UL
+#define SHM_CACHE_VERSION 2
+
+// Layout parameters.
+#define SHM_CACHE_SHARDS    16
+#define SHM_CACHE_AVG_PAGE  4096
+#define SHM_CACHE_MIN_SLOTS 16
+#define SHM_CACHE_ALIGN     8
+
+// Aligns a size to the alignment of the records.
+#define SHM_ALIGN(n) (((n) + (SHM_CACHE_ALIGN - 1)) & \
+	~(uint64_t)(SHM_CACHE_ALIGN - 1))
+
+// Cache header. (Lives at the start of the mapping)
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	uint32_t nshards;
+	uint32_t nslots;
+	uint64_t shard_size;
+	uint64_t data_size;
+} shm_header_t;
+
+// Shard header. (Followed by its slots and then its data area)
+typedef struct {
+	pthread_mutex_t lock;
+	uint64_t head;
+} shm_shard_t;
+
+// Slot pointing to a page in the data area of a shard.
+typedef struct {
+	uint64_t hash;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t used;
+} shm_slot_t;
+
+// Page record. (Followed by the page path, contents, gzipped contents,
+// dependency information and dependency paths)
+typedef struct {
+	uint64_t size;
+	uint64_t fingerprint;
+	uint64_t page_len;
+	uint64_t data_len;
+	uint64_t gzip_len;
+	uint64_t ndeps;
+	uint64_t deps_len;
+} shm_record_t;
+
+// Private methods.
+void init_layout(shm_header_t *header, const size_t size);
+bool init_shard(shm_shard_t *shard);
+shm_shard_t* get_shard(shm_cache_t *cache, const unsigned long hash);
+shm_slot_t* shard_slots(shm_cache_t *cache, shm_shard_t *shard);
+char* shard_data(shm_cache_t *cache, shm_shard_t *shard);
+void lock_shard(shm_cache_t *cache, shm_shard_t *shard);
+void clear_shard(shm_cache_t *cache, shm_shard_t *shard);
+shm_slot_t* find_slot(shm_cache_t *cache, shm_shard_t *shard,
+					  const unsigned long hash, const char *page,
+					  const unsigned long fingerprint);
+shm_slot_t* claim_slot(shm_cache_t *cache, shm_shard_t *shard,
+					   const uint64_t size);
+page_cache_entry_t* unpack_record(page_cache_t *local, const char *rec);
+#endif
+
+/**
+ * Maps a shared cache, creating and setting it up if it doesn't exist yet or
+ * if whoever created it died before it was set up.
+ * @remark If the cache already exists it's used with the size it was created
+ *         with, regardless of the size asked for.
+ *
+ * @param  cache Shared cache handle.
+ * @param  path  Path to the file backing the cache. (Ideally under /dev/shm)
+ * @param  size  Size of the cache in bytes.
+ * @return       TRUE if the cache is ready to be used.
+ */
+bool shm_cache_open(shm_cache_t *cache, const char *path, const size_t size) {
+#ifdef UNIX
+	shm_header_t header;
+	struct stat st;
+	uint32_t magic;
+	bool fresh;
+	size_t i;
+	int fd;
+
+	cache->base = NULL;
+	cache->size = 0;
+
+	// Make sure the size makes sense for our layout.
+	init_layout(&header, size);
+	if (header.data_size == 0)
+		return false;
+
+	// Keep everyone else out while we figure out if it needs to be set up.
+	if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+		return false;
+	if (flock(fd, LOCK_EX) != 0) {
+		close(fd);
+		return false;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+
+	// The magic goes in last, so without it the cache was never set up.
+	fresh = (st.st_size < (off_t)sizeof(shm_header_t)) ||
+		(pread(fd, &magic, sizeof(magic), 0) != (ssize_t)sizeof(magic)) ||
+		(magic == 0);
+	if (fresh && ((ftruncate(fd, 0) != 0) ||
+				  (ftruncate(fd, (off_t)size) != 0))) {
+		close(fd);
+		return false;
+	}
+	cache->size = (fresh) ? size : (size_t)st.st_size;
+	cache->base = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+					   fd, 0);
+	if (cache->base == MAP_FAILED) {
+		close(fd);
+		cache->base = NULL;
+		cache->size = 0;
+
+		return false;
+	}
+
+	if (fresh) {
+		// Brand new cache, so set it up with the magic going in last.
+		header.magic = 0;
+		memcpy(cache->base, &header, sizeof(shm_header_t));
+		for (i = 0; i < header.nshards; i++) {
+			if (!init_shard(get_shard(cache, i))) {
+				shm_cache_close(cache);
+				close(fd);
+
+				return false;
+			}
+		}
+		((shm_header_t*)cache->base)->magic = SHM_CACHE_MAGIC;
+	} else {
+		// Make sure someone else's cache is something we can work with.
+		memcpy(&header, cache->base, sizeof(shm_header_t));
+		if ((header.magic != SHM_CACHE_MAGIC) ||
+				(header.version != SHM_CACHE_VERSION) ||
+				(header.size != cache->size)) {
+			shm_cache_close(cache);
+			close(fd);
+
+			return false;
+		}
+	}
+
+	// The mapping outlives the descriptor.
+	close(fd);
+	return true;
+#else
+	(void)path;
+	(void)size;
+
+	cache->base = NULL;
+	cache->size = 0;
+
+	return false;
+#endif
+}
+
+/**
+ * Unmaps a shared cache. Its contents stay around for the other processes.
+ *
+ * @param cache Shared cache handle.
+ */
+void shm_cache_close(shm_cache_t *cache) {
+#ifdef UNIX
+	if (cache->base != NULL)
+		munmap(cache->base, cache->size);
+#endif
+
+	cache->base = NULL;
+	cache->size = 0;
+}
+
+/**
+ * Throws away every page in a shared cache, for every process using it.
+ *
+ * @param cache Shared cache handle.
+ */
+void shm_cache_flush(shm_cache_t *cache) {
+#ifdef UNIX
+	shm_header_t *header = (shm_header_t*)cache->base;
+	shm_shard_t *shard;
+	uint32_t i;
+
+	for (i = 0; i < header->nshards; i++) {
+		shard = get_shard(cache, i);
+		lock_shard(cache, shard);
+		clear_shard(cache, shard);
+		pthread_mutex_unlock(&shard->lock);
+	}
+#else
+	(void)cache;
+#endif
+}
+
+/**
+ * Copies a page out of a shared cache.
+ * @remark The page still has to be validated by the caller.
+ *
+ * @param  cache       Shared cache handle.
+ * @param  local       Page cache the copied entry is going into.
+ * @param  page        Path of the page.
+ * @param  fingerprint Fingerprint of the settings the page must match.
+ * @return             New page cache entry or NULL if the page isn't there.
+ */
+page_cache_entry_t* shm_cache_get(shm_cache_t *cache, page_cache_t *local,
+								  const char *page,
+								  const unsigned long fingerprint) {
+#ifdef UNIX
+	page_cache_entry_t *entry;
+	shm_shard_t *shard;
+	shm_slot_t *slot;
+	unsigned long hash;
+	char *rec;
+
+	// Copy the record out so that we hold the lock for as little as possible.
+	hash = strhash(page);
+	shard = get_shard(cache, hash);
+	lock_shard(cache, shard);
+	if ((slot = find_slot(cache, shard, hash, page, fingerprint)) == NULL) {
+		pthread_mutex_unlock(&shard->lock);
+		return NULL;
+	}
+	rec = (char*)mem_malloc(slot->size);
+	memcpy(rec, shard_data(cache, shard) + slot->offset, slot->size);
+	pthread_mutex_unlock(&shard->lock);
+
+	entry = unpack_record(local, rec);
+	mem_free(rec);
+
+	return entry;
+#else
+	(void)cache;
+	(void)local;
+	(void)page;
+	(void)fingerprint;
+
+	return NULL;
+#endif
+}
+
+/**
+ * Copies a rendered page into a shared cache, replacing any older version of
+ * it and evicting the oldest pages in its shard to make room for it.
+ *
+ * @param cache       Shared cache handle.
+ * @param entry       Populated page cache entry.
+ * @param fingerprint Fingerprint of the settings the page was rendered with.
+ */
+void shm_cache_put(shm_cache_t *cache, const page_cache_entry_t *entry,
+				   const unsigned long fingerprint) {
+#ifdef UNIX
+	shm_record_t rec;
+	shm_shard_t *shard;
+	shm_slot_t *slot;
+	char *pos;
+	size_t i;
+
+	// Work out how big the record is going to be.
+	rec.fingerprint = fingerprint;
+	rec.page_len = strlen(entry->page) + 1;
+	rec.data_len = entry->len;
+	rec.gzip_len = entry->gzip_len;
+	rec.ndeps = entry->ndeps;
+	rec.deps_len = 0;
+	for (i = 0; i < entry->ndeps; i++)
+		rec.deps_len += strlen(entry->deps[i]) + 1;
+	rec.size = SHM_ALIGN(sizeof(shm_record_t) + rec.page_len + rec.data_len +
+		rec.gzip_len + (sizeof(file_info_t) * rec.ndeps) + rec.deps_len);
+
+	// Get rid of the older version and find it a place.
+	shard = get_shard(cache, entry->hash);
+	lock_shard(cache, shard);
+	if ((slot = find_slot(cache, shard, entry->hash, entry->page,
+						  fingerprint)) != NULL)
+		slot->used = 0;
+	if ((slot = claim_slot(cache, shard, rec.size)) == NULL) {
+		pthread_mutex_unlock(&shard->lock);
+		return;
+	}
+
+	// Write it in.
+	pos = shard_data(cache, shard) + slot->offset;
+	memcpy(pos, &rec, sizeof(shm_record_t));
+	pos += sizeof(shm_record_t);
+	memcpy(pos, entry->page, rec.page_len);
+	pos += rec.page_len;
+	memcpy(pos, entry->data, rec.data_len);
+	pos += rec.data_len;
+	if (rec.gzip_len > 0)
+		memcpy(pos, entry->gzip, rec.gzip_len);
+	pos += rec.gzip_len;
+	if (rec.ndeps > 0)
+		memcpy(pos, entry->deps_info, sizeof(file_info_t) * rec.ndeps);
+	pos += sizeof(file_info_t) * rec.ndeps;
+	for (i = 0; i < entry->ndeps; i++) {
+		strcpy(pos, entry->deps[i]);
+		pos += strlen(entry->deps[i]) + 1;
+	}
+	slot->hash = entry->hash;
+	slot->used = 1;
+	pthread_mutex_unlock(&shard->lock);
+#else
+	(void)cache;
+	(void)entry;
+	(void)fingerprint;
+#endif
+}
+
+/**
+ * Removes a page from a shared cache if it's there.
+ *
+ * @param cache       Shared cache handle.
+ * @param page        Path of the page.
+ * @param fingerprint Fingerprint of the settings the page was rendered with.
+ */
+void shm_cache_remove(shm_cache_t *cache, const char *page,
+					  const unsigned long fingerprint) {
+#ifdef UNIX
+	shm_shard_t *shard;
+	shm_slot_t *slot;
+	unsigned long hash;
+
+	hash = strhash(page);
+	shard = get_shard(cache, hash);
+	lock_shard(cache, shard);
+	if ((slot = find_slot(cache, shard, hash, page, fingerprint)) != NULL)
+		slot->used = 0;
+	pthread_mutex_unlock(&shard->lock);
+#else
+	(void)cache;
+	(void)page;
+	(void)fingerprint;
+#endif
+}
+
+#ifdef UNIX
+/**
+ * Works out how a mapping of a given size is going to be laid out.
+ *
+ * @param header Cache header to be populated. (data_size is 0 if the size is
+ *               too small)
+ * @param size   Size of the mapping in bytes.
+ */
+void init_layout(shm_header_t *header, const size_t size) {
+	uint64_t overhead;
+
+	header->magic = SHM_CACHE_MAGIC;
+	header->version = SHM_CACHE_VERSION;
+	header->size = size;
+	header->nshards = SHM_CACHE_SHARDS;
+	header->nslots = (uint32_t)(size / (SHM_CACHE_AVG_PAGE * SHM_CACHE_SHARDS));
+	if (header->nslots < SHM_CACHE_MIN_SLOTS)
+		header->nslots = SHM_CACHE_MIN_SLOTS;
+	header->shard_size = 0;
+	header->data_size = 0;
+
+	// Split what's left after the header evenly between the shards.
+	if (size <= SHM_ALIGN(sizeof(shm_header_t)))
+		return;
+	header->shard_size = ((size - SHM_ALIGN(sizeof(shm_header_t))) /
+		header->nshards) & ~(uint64_t)(SHM_CACHE_ALIGN - 1);
+	overhead = SHM_ALIGN(sizeof(shm_shard_t)) +
+		SHM_ALIGN(sizeof(shm_slot_t) * header->nslots);
+	if (header->shard_size > overhead + SHM_CACHE_AVG_PAGE)
+		header->data_size = header->shard_size - overhead;
+}
+
+/**
+ * Sets up a brand new shard.
+ *
+ * @param  shard Shard in the mapping. (Already zeroed out by the mapping)
+ * @return       TRUE if its lock could be set up to be shared.
+ */
+bool init_shard(shm_shard_t *shard) {
+	pthread_mutexattr_t attr;
+	bool ok;
+
+	if (pthread_mutexattr_init(&attr) != 0)
+		return false;
+	ok = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) == 0;
+#ifdef __linux__
+	// Don't let a worker that crashed while holding the lock take us with it.
+	ok = ok && (pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) == 0);
+#endif
+	ok = ok && (pthread_mutex_init(&shard->lock, &attr) == 0);
+	pthread_mutexattr_destroy(&attr);
+
+	shard->head = 0;
+	return ok;
+}
+
+/**
+ * Gets the shard responsible for a page.
+ *
+ * @param  cache Shared cache handle.
+ * @param  hash  Hash of the page path.
+ * @return       Shard in the mapping.
+ */
+shm_shard_t* get_shard(shm_cache_t *cache, const unsigned long hash) {
+	shm_header_t *header = (shm_header_t*)cache->base;
+
+	return (shm_shard_t*)((char*)cache->base +
+		SHM_ALIGN(sizeof(shm_header_t)) +
+		(header->shard_size * (hash % header->nshards)));
+}
+
+/**
+ * Gets the slot table of a shard.
+ *
+ * @param  cache Shared cache handle.
+ * @param  shard Shard in the mapping.
+ * @return       Slots of the shard.
+ */
+shm_slot_t* shard_slots(shm_cache_t *cache, shm_shard_t *shard) {
+	(void)cache;
+	return (shm_slot_t*)((char*)shard + SHM_ALIGN(sizeof(shm_shard_t)));
+}
+
+/**
+ * Gets the data area of a shard.
+ *
+ * @param  cache Shared cache handle.
+ * @param  shard Shard in the mapping.
+ * @return       Start of the data area of the shard.
+ */
+char* shard_data(shm_cache_t *cache, shm_shard_t *shard) {
+	shm_header_t *header = (shm_header_t*)cache->base;
+
+	return (char*)shard_slots(cache, shard) +
+		SHM_ALIGN(sizeof(shm_slot_t) * header->nslots);
+}
+
+/**
+ * Locks a shard. If the last process to hold it died while holding it, the
+ * shard is thrown away since there's no telling what state it was left in.
+ *
+ * @param cache Shared cache handle.
+ * @param shard Shard to be locked.
+ */
+void lock_shard(shm_cache_t *cache, shm_shard_t *shard) {
+#ifdef __linux__
+	if (pthread_mutex_lock(&shard->lock) == EOWNERDEAD) {
+		clear_shard(cache, shard);
+		pthread_mutex_consistent(&shard->lock);
+	}
+#else
+	(void)cache;
+	pthread_mutex_lock(&shard->lock);
+#endif
+}
+
+/**
+ * Throws away every page in a shard.
+ * @remark The shard must be locked.
+ *
+ * @param cache Shared cache handle.
+ * @param shard Shard in the mapping.
+ */
+void clear_shard(shm_cache_t *cache, shm_shard_t *shard) {
+	shm_header_t *header = (shm_header_t*)cache->base;
+
+	memset(shard_slots(cache, shard), 0, sizeof(shm_slot_t) * header->nslots);
+	shard->head = 0;
+}
+
+/**
+ * Finds the slot of a page in a shard.
+ * @remark The shard must be locked.
+ *
+ * @param  cache       Shared cache handle.
+ * @param  shard       Shard responsible for the page.
+ * @param  hash        Hash of the page path.
+ * @param  page        Path of the page.
+ * @param  fingerprint Fingerprint of the settings the page must match.
+ * @return             Slot of the page or NULL if it isn't there.
+ */
+shm_slot_t* find_slot(shm_cache_t *cache, shm_shard_t *shard,
+					  const unsigned long hash, const char *page,
+					  const unsigned long fingerprint) {
+	shm_header_t *header = (shm_header_t*)cache->base;
+	shm_slot_t *slots = shard_slots(cache, shard);
+	shm_record_t *rec;
+	uint32_t i;
+
+	for (i = 0; i < header->nslots; i++) {
+		if (!slots[i].used || (slots[i].hash != hash))
+			continue;
+
+		rec = (shm_record_t*)(shard_data(cache, shard) + slots[i].offset);
+		if ((rec->fingerprint == fingerprint) &&
+				(strcmp((char*)rec + sizeof(shm_record_t), page) == 0))
+			return &slots[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Claims a free slot and room for a record in the data area of a shard,
+ * evicting every page that is in the way.
+ * @remark The shard must be locked.
+ *
+ * @param  cache Shared cache handle.
+ * @param  shard Shard in the mapping.
+ * @param  size  Size of the record.
+ * @return       Claimed slot (with its offset and size set, but not in use)
+ *               or NULL if the record will never fit.
+ */
+shm_slot_t* claim_slot(shm_cache_t *cache, shm_shard_t *shard,
+					   const uint64_t size) {
+	shm_header_t *header = (shm_header_t*)cache->base;
+	shm_slot_t *slots = shard_slots(cache, shard);
+	shm_slot_t *slot = NULL;
+	uint64_t oldest = 0;
+	uint64_t age;
+	uint32_t i;
+
+	if (size > header->data_size)
+		return NULL;
+
+	// Wrap around if it doesn't fit in what's left of the ring.
+	if (shard->head + size > header->data_size)
+		shard->head = 0;
+
+	// Evict whatever is in the way and look for a free slot.
+	for (i = 0; i < header->nslots; i++) {
+		if (slots[i].used && (slots[i].offset < shard->head + size) &&
+				(slots[i].offset + slots[i].size > shard->head))
+			slots[i].used = 0;
+		if (!slots[i].used && (slot == NULL))
+			slot = &slots[i];
+	}
+
+	// Out of slots, so evict the page that's next in line to be overwritten.
+	if (slot == NULL) {
+		for (i = 0; i < header->nslots; i++) {
+			age = (slots[i].offset + header->data_size - shard->head) %
+				header->data_size;
+			if ((slot == NULL) || (age < oldest)) {
+				slot = &slots[i];
+				oldest = age;
+			}
+		}
+		slot->used = 0;
+	}
+
+	slot->offset = shard->head;
+	slot->size = size;
+	shard->head += size;
+
+	return slot;
+}
+
+/**
+ * Builds a page cache entry out of a record copied out of the cache.
+ *
+ * @param  local Page cache the entry is going into.
+ * @param  rec   Copy of the record.
+ * @return       New page cache entry.
+ */
+page_cache_entry_t* unpack_record(page_cache_t *local, const char *rec) {
+	page_cache_entry_t *entry;
+	shm_record_t header;
+	const char *pos;
+	size_t i;
+
+	memcpy(&header, rec, sizeof(shm_record_t));
+	pos = rec + sizeof(shm_record_t);
+	entry = page_cache_entry(local, pos);
+	pos += header.page_len;
+
+	// Contents.
+	entry->len = (size_t)header.data_len;
+	entry->data = (char*)mem_malloc((entry->len + 1) * sizeof(char));
+	memcpy(entry->data, pos, entry->len);
+	entry->data[entry->len] = '\0';
+	pos += header.data_len;
+	if (header.gzip_len > 0) {
+		entry->gzip_len = (size_t)header.gzip_len;
+		entry->gzip = (char*)mem_malloc(entry->gzip_len);
+		memcpy(entry->gzip, pos, entry->gzip_len);
+	}
+	pos += header.gzip_len;
+
+	// Dependencies.
+	entry->ndeps = (size_t)header.ndeps;
+	if (entry->ndeps > 0) {
+		entry->deps = (char**)mem_malloc(sizeof(char*) * entry->ndeps);
+		entry->deps_info = (file_info_t*)mem_malloc(sizeof(file_info_t) *
+													entry->ndeps);
+		memcpy(entry->deps_info, pos, sizeof(file_info_t) * entry->ndeps);
+	}
+	pos += sizeof(file_info_t) * header.ndeps;
+	for (i = 0; i < entry->ndeps; i++) {
+		entry->deps[i] = (char*)mem_malloc((strlen(pos) + 1) * sizeof(char));
+		strcpy(entry->deps[i], pos);
+		pos += strlen(pos) + 1;
+	}
+
+	return entry;
+}
+#endif
@@ -0,0 +1,38 @@
+/**
+ * shmcache.h
+ * A rendered pages cache in shared memory for sharing between processes.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#ifndef _SHMCACHE_H_
+#define _SHMCACHE_H_
+
+#include "windowshelper.h"
+#include "pagecache.h"
+#include <stdlib.h>
+#ifdef UNIX
+#include <stdbool.h>
+#endif
+
+// Shared cache handle.
+typedef struct {
+	void *base;
+	size_t size;
+} shm_cache_t;
+
+// Initialization and destruction.
+bool shm_cache_open(shm_cache_t *cache, const char *path, const size_t size);
+void shm_cache_close(shm_cache_t *cache);
+void shm_cache_flush(shm_cache_t *cache);
+
+// Lookup.
+page_cache_entry_t* shm_cache_get(shm_cache_t *cache, page_cache_t *local,
+								  const char *page,
+								  const unsigned long fingerprint);
+void shm_cache_put(shm_cache_t *cache, const page_cache_entry_t *entry,
+				   const unsigned long fingerprint);
+void shm_cache_remove(shm_cache_t *cache, const char *page,
+					  const unsigned long fingerprint);
+
+#endif /* _SHMCACHE_H_ */
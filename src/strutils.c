@@ -6,8 +6,155 @@
  */
 
 #include "strutils.h"
+#include "allocator.h"
 #include <string.h>
 
+/**
+ * Initializes a string builder.
+ *
+ * @param buf      String builder structure.
+ * @param capacity Initial capacity of the buffer.
+ */
+void strbuf_init(strbuf_t *buf, const size_t capacity) {
+	buf->len = 0;
+	buf->capacity = (capacity > 0) ? capacity : 1;
+	buf->fixed = false;
+	buf->arena = NULL;
+	buf->str = (char*)mem_malloc(buf->capacity * sizeof(char));
+	buf->str[0] = '\0';
+}
+
+/**
+ * Initializes a string builder that grows inside an arena. The built string
+ * is only copied into the heap when it gets detached.
+ *
+ * @param buf      String builder structure.
+ * @param arena    Arena to allocate the buffer from.
+ * @param capacity Initial capacity of the buffer.
+ */
+void strbuf_init_arena(strbuf_t *buf, arena_t *arena, const size_t capacity) {
+	buf->len = 0;
+	buf->capacity = (capacity > 0) ? capacity : 1;
+	buf->fixed = false;
+	buf->arena = arena;
+	buf->str = (char*)arena_alloc(arena, buf->capacity * sizeof(char));
+	buf->str[0] = '\0';
+}
+
+/**
+ * Initializes a string builder on top of a caller supplied buffer that will
+ * never be grown. Anything that doesn't fit is left out, but is still counted
+ * in the length of the string, just like snprintf.
+ *
+ * @param buf      String builder structure.
+ * @param str      Pre-allocated buffer. (Can be NULL if capacity is 0)
+ * @param capacity Size of the buffer including space for the terminator.
+ */
+void strbuf_init_fixed(strbuf_t *buf, char *str, const size_t capacity) {
+	buf->len = 0;
+	buf->capacity = capacity;
+	buf->fixed = true;
+	buf->arena = NULL;
+	buf->str = str;
+
+	if (capacity > 0)
+		buf->str[0] = '\0';
+}
+
+/**
+ * Checks if the string didn't fit in a fixed string builder.
+ *
+ * @param  buf String builder structure.
+ * @return     TRUE if the string has been truncated.
+ */
+bool strbuf_overflowed(const strbuf_t *buf) {
+	return (buf->len + 1) > buf->capacity;
+}
+
+/**
+ * Appends a string with a known length to the string builder, growing its
+ * buffer geometrically if needed.
+ *
+ * @param buf String builder structure.
+ * @param str String to be appended. (Doesn't need to be NULL terminated)
+ * @param len Number of characters to append.
+ */
+void strbuf_append(strbuf_t *buf, const char *str, const size_t len) {
+	// Copy whatever still fits in a fixed buffer and just keep counting.
+	if (buf->fixed && ((buf->len + len + 1) > buf->capacity)) {
+		if ((buf->len + 1) < buf->capacity) {
+			memcpy(buf->str + buf->len, str, buf->capacity - buf->len - 1);
+			buf->str[buf->capacity - 1] = '\0';
+		}
+
+		buf->len += len;
+		return;
+	}
+
+	// Grow the buffer making sure we always have space for the terminator.
+	if ((buf->len + len + 1) > buf->capacity) {
+		size_t oldcap = buf->capacity;
+		while ((buf->len + len + 1) > buf->capacity)
+			buf->capacity *= 2;
+
+		if (buf->arena != NULL) {
+			buf->str = (char*)arena_grow(buf->arena, buf->str, oldcap,
+										 buf->capacity * sizeof(char));
+		} else {
+			buf->str = (char*)mem_realloc(buf->str,
+										  buf->capacity * sizeof(char));
+		}
+	}
+
+	// Append the string.
+	memcpy(buf->str + buf->len, str, len);
+	buf->len += len;
+	buf->str[buf->len] = '\0';
+}
+
+/**
+ * Appends a NULL terminated string to the string builder.
+ *
+ * @param buf String builder structure.
+ * @param str String to be appended.
+ */
+void strbuf_appends(strbuf_t *buf, const char *str) {
+	strbuf_append(buf, str, strlen(str));
+}
+
+/**
+ * Hands over the built string to the caller and resets the string builder.
+ *
+ * @param  buf String builder structure.
+ * @return     Built string. (Must be freed by the caller)
+ */
+char* strbuf_detach(strbuf_t *buf) {
+	char *str = buf->str;
+
+	// Get the string out of the arena.
+	if (buf->arena != NULL)
+		str = (char*)arena_detach(buf->str, (buf->len + 1) * sizeof(char));
+
+	buf->str = NULL;
+	buf->len = 0;
+	buf->capacity = 0;
+
+	return str;
+}
+
+/**
+ * Frees a string builder.
+ *
+ * @param buf String builder structure.
+ */
+void strbuf_free(strbuf_t *buf) {
+	if (!buf->fixed && (buf->arena == NULL))
+		mem_free(buf->str);
+	buf->str = NULL;
+	buf->len = 0;
+	buf->capacity = 0;
+}
+
 /**
  * Puts a string inside another string given a position.
  *
@@ -20,8 +167,8 @@ void strnreplace(char **haystack, const spos_t pos, const char *substr) {
 	char *right;
 
 	// Allocate memory for our left and right side strings.
-	left = (char*)malloc((pos.begin + 1) * sizeof(char));
-	right = (char*)malloc((strlen(*haystack) - pos.end + 1) * sizeof(char));
+	left = (char*)mem_malloc((pos.begin + 1) * sizeof(char));
+	right = (char*)mem_malloc((strlen(*haystack) - pos.end + 1) * sizeof(char));
 
 	// Populate our left and right side strings.
 	memcpy(left, *haystack, pos.begin);
@@ -29,15 +176,15 @@ void strnreplace(char **haystack, const spos_t pos, const char *substr) {
 	strcpy(right, *haystack + pos.end);
 
 	// Reallocate memory for our substituted string and copy its contents.
-	*haystack = (char*)realloc(*haystack, (strlen(left) + strlen(right) +
+	*haystack = (char*)mem_realloc(*haystack, (strlen(left) + strlen(right) +
 										   strlen(substr) + 1) * sizeof(char));
 	strcpy(*haystack, left);
 	strcpy(*haystack + strlen(left), substr);
 	strcpy(*haystack + strlen(left) + strlen(substr), right);
 
 	// Clean up our mess.
-	free(left);
-	free(right);
+	mem_free(left);
+	mem_free(right);
 }
 
 /**
@@ -80,3 +227,20 @@ spos_t strsubstpos(const char *haystack, const char *needle) {
 
 	return pos;
 }
+
+/**
+ * Calculates a FNV-1a hash of a string.
+ *
+ * @param  str String to be hashed.
+ * @return     Hash of the string.
+ */
+unsigned long strhash(const char *str) {
+	unsigned long hash = 2166136261UL;
+
+	for (; *str != '\0'; str++) {
+		hash ^= (unsigned char)*str;
+		hash *= 16777619UL;
+	}
+
+	return hash;
+}
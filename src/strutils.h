@@ -8,7 +8,12 @@
 #ifndef _STRUTILS_H_
 #define _STRUTILS_H_
 
+#include "windowshelper.h"
+#include "arena.h"
 #include <stdlib.h>
+#ifdef UNIX
+#include <stdbool.h>
+#endif
 
 // Subsitution position structure.
 typedef struct {
@@ -16,9 +21,31 @@ typedef struct {
 	size_t end;
 } spos_t;
 
+// String builder structure.
+typedef struct {
+	char  *str;
+	size_t len;
+	size_t capacity;
+	bool   fixed;
+	arena_t *arena;
+} strbuf_t;
+
+// String building.
+void strbuf_init(strbuf_t *buf, const size_t capacity);
+void strbuf_init_fixed(strbuf_t *buf, char *str, const size_t capacity);
+void strbuf_init_arena(strbuf_t *buf, arena_t *arena, const size_t capacity);
+bool strbuf_overflowed(const strbuf_t *buf);
+void strbuf_append(strbuf_t *buf, const char *str, const size_t len);
+void strbuf_appends(strbuf_t *buf, const char *str);
+char* strbuf_detach(strbuf_t *buf);
+void strbuf_free(strbuf_t *buf);
+
 // Find and Replace.
 void strnreplace(char **haystack, const spos_t pos, const char *substr);
 void strsreplace(char **haystack, const char *needle, const char *substr);
 spos_t strsubstpos(const char *haystack, const char *needle);
 
+// Hashing.
+unsigned long strhash(const char *str);
+
 #endif /* _STRUTILS_H_ */
@@ -0,0 +1,188 @@
+/**
+ * sync.c
+ * Portable atomic operations and synchronization primitives.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#include "sync.h"
+#ifdef UNIX
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
+/**
+ * Initializes a mutex.
+ *
+ * @param mutex Mutex to be initialized.
+ */
+void mutex_init(mutex_t *mutex) {
+#ifdef WINDOWS
+	InitializeCriticalSection(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+/**
+ * Locks a mutex, waiting for it to be released if someone else holds it.
+ *
+ * @param mutex Mutex to be locked.
+ */
+void mutex_lock(mutex_t *mutex) {
+#ifdef WINDOWS
+	EnterCriticalSection(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+/**
+ * Unlocks a mutex.
+ *
+ * @param mutex Mutex to be unlocked.
+ */
+void mutex_unlock(mutex_t *mutex) {
+#ifdef WINDOWS
+	LeaveCriticalSection(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+/**
+ * Destroys a mutex that is no longer needed.
+ *
+ * @param mutex Mutex to be destroyed.
+ */
+void mutex_destroy(mutex_t *mutex) {
+#ifdef WINDOWS
+	DeleteCriticalSection(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+/**
+ * Initializes a counting semaphore with a count of zero.
+ *
+ * @param sem Semaphore to be initialized.
+ */
+void semaphore_init(semaphore_t *sem) {
+#ifdef WINDOWS
+	*sem = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+#else
+	pthread_mutex_init(&sem->lock, NULL);
+	pthread_cond_init(&sem->cond, NULL);
+	sem->count = 0;
+#endif
+}
+
+/**
+ * Waits for a semaphore to be posted and takes one from its count.
+ *
+ * @param sem Semaphore to wait on.
+ */
+void semaphore_wait(semaphore_t *sem) {
+#ifdef WINDOWS
+	WaitForSingleObject(*sem, INFINITE);
+#else
+	pthread_mutex_lock(&sem->lock);
+	while (sem->count == 0)
+		pthread_cond_wait(&sem->cond, &sem->lock);
+	sem->count--;
+	pthread_mutex_unlock(&sem->lock);
+#endif
+}
+
+/**
+ * Waits for a semaphore to be posted for a while and takes one from its count
+ * if it was.
+ *
+ * @param  sem Semaphore to wait on.
+ * @param  ms  Maximum time to wait for in milliseconds.
+ * @return     TRUE if the semaphore was posted, FALSE if we timed out.
+ */
+bool semaphore_timedwait(semaphore_t *sem, const unsigned long ms) {
+#ifdef WINDOWS
+	return WaitForSingleObject(*sem, ms) == WAIT_OBJECT_0;
+#else
+	struct timespec deadline;
+	bool posted;
+
+	// Work out when we should give up.
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += ms / 1000;
+	deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&sem->lock);
+	while (sem->count == 0) {
+		if (pthread_cond_timedwait(&sem->cond, &sem->lock,
+								   &deadline) == ETIMEDOUT)
+			break;
+	}
+	posted = sem->count > 0;
+	if (posted)
+		sem->count--;
+	pthread_mutex_unlock(&sem->lock);
+
+	return posted;
+#endif
+}
+
+/**
+ * Posts to a semaphore, waking up to count waiting threads.
+ *
+ * @param sem   Semaphore to be posted.
+ * @param count How much to add to its count.
+ */
+void semaphore_post(semaphore_t *sem, const unsigned long count) {
+#ifdef WINDOWS
+	ReleaseSemaphore(*sem, (LONG)count, NULL);
+#else
+	pthread_mutex_lock(&sem->lock);
+	sem->count += count;
+	if (count == 1) {
+		pthread_cond_signal(&sem->cond);
+	} else {
+		pthread_cond_broadcast(&sem->cond);
+	}
+	pthread_mutex_unlock(&sem->lock);
+#endif
+}
+
+/**
+ * Destroys a semaphore that is no longer needed.
+ *
+ * @param sem Semaphore to be destroyed.
+ */
+void semaphore_destroy(semaphore_t *sem) {
+#ifdef WINDOWS
+	CloseHandle(*sem);
+#else
+	pthread_cond_destroy(&sem->cond);
+	pthread_mutex_destroy(&sem->lock);
+#endif
+}
+
+/**
+ * Gets the number of processors available to us.
+ *
+ * @return Number of online processors. (At least 1)
+ */
+size_t cpu_count(void) {
+#ifdef WINDOWS
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (size_t)n : 1;
+#endif
+}
@@ -0,0 +1,75 @@
+/**
+ * sync.h
+ * Portable atomic operations and synchronization primitives.
+ *
+ * @author: Nathan Campos <hi@nathancampos.me>
+ */
+
+#ifndef _SYNC_H_
+#define _SYNC_H_
+
+#include "windowshelper.h"
+#include <stdlib.h>
+#ifdef UNIX
+#include <pthread.h>
+#include <stdbool.h>
+#endif
+
+// Mutex type.
+#ifdef WINDOWS
+typedef CRITICAL_SECTION mutex_t;
+#else
+typedef pthread_mutex_t mutex_t;
+#endif
+
+// Counting semaphore type.
+#ifdef WINDOWS
+typedef HANDLE semaphore_t;
+#else
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned long count;
+} semaphore_t;
+#endif
+
+// Atomic operations. (All of them act as full memory barriers and the non
+// pointer ones must only be used on long or unsigned long values, since that's
+// the size the Interlocked functions work with)
+#ifdef WINDOWS
+#define sync_load(p)          InterlockedCompareExchange((LONG*)(p), 0, 0)
+#define sync_store(p, v)      InterlockedExchange((LONG*)(p), (LONG)(v))
+#define sync_add(p, v)        (InterlockedExchangeAdd((LONG*)(p), \
+											  (LONG)(v)) + (v))
+#define sync_load_ptr(p)      InterlockedCompareExchangePointer((PVOID*)(p), \
+																NULL, NULL)
+#define sync_store_ptr(p, v)  InterlockedExchangePointer((PVOID*)(p), \
+														 (PVOID)(v))
+#define sync_swap_ptr(p, v)   InterlockedExchangePointer((PVOID*)(p), \
+														 (PVOID)(v))
+#else
+#define sync_load(p)          __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define sync_store(p, v)      __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define sync_add(p, v)        __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define sync_load_ptr(p)      sync_load(p)
+#define sync_store_ptr(p, v)  sync_store(p, v)
+#define sync_swap_ptr(p, v)   __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#endif
+
+// Locking.
+void mutex_init(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+void mutex_destroy(mutex_t *mutex);
+
+// Signaling.
+void semaphore_init(semaphore_t *sem);
+void semaphore_wait(semaphore_t *sem);
+bool semaphore_timedwait(semaphore_t *sem, const unsigned long ms);
+void semaphore_post(semaphore_t *sem, const unsigned long count);
+void semaphore_destroy(semaphore_t *sem);
+
+// System information.
+size_t cpu_count(void);
+
+#endif /* _SYNC_H_ */
@@ -8,7 +8,9 @@
 #include "constants.h"
 #include "template.h"
 #include "fileutils.h"
-#include "strutils.h"
+#include "arena.h"
+#include "allocator.h"
+#include "sync.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,42 +18,114 @@
 #include <stdint.h>
 #endif
 
-// Substitution types.
-#define SUBSTITUTE_STRING   0
-#define SUBSTITUTE_VARIABLE 1
-#define SUBSTITUTE_TEMPLATE 2
+// Template tags.
+#define TEMPLATE_TAG_MAX_CHAR  50
+#define TEMPLATE_INCLUDE_BEGIN '['
+#define TEMPLATE_INCLUDE_END   ']'
+#define TEMPLATE_VAR_DELIM     '%'
+#define TEMPLATE_BODY_VAR      "_body_"
+#define TEMPLATE_MAX_DEPTH     32
 
-// sscanf matching.
-#define TEMPLATE_FILE_MATCH "%*[^[][%49[^]]]%*[^]]"
-#define TEMPLATE_VAR_MATCH  "%*[^%]%%%49[^%]%%%*[^%]"
-#define TEMPLATE_BODY_MATCH "%_body_%"
+// Extra space reserved for the template when rendering a page.
+#define TEMPLATE_RENDER_SLACK 4096
 
-// Global variables.
-const char *wiki_root_path;
-char template_path[UKI_MAX_PATH];
+// Initial number of cache table slots. (Must be a power of two)
+#define TEMPLATE_INITIAL_SLOTS 16
+
+// Rendering state.
+typedef struct {
+	arena_t *arena;
+	strbuf_t *out;
+	uki_page_iov_t *iov;
+	uki_template_cache *cache;
+	unsigned long ticket;
+	const uki_page_skeleton_t *skeleton;
+	const uki_variable_container *variables;
+	const file_view_t *body;
+	bool split;
+	size_t nbodies;
+	size_t body_pos;
+} render_state_t;
 
 // Private methods.
-void replace_string(char **haystack, const char *needle, const char *substr,
-					const uint8_t type);
-uki_error substitute_templates(char **template);
-void populate_template_from_path(uki_template_t *template, const char *fpath);
+uki_error load_template(const uki_template_cache *cache,
+						const char *template_name,
+						uki_compiled_template_t **compiled);
+uki_error template_cache_entry(uki_template_cache *cache,
+							   const char *template_name,
+							   const unsigned long ticket,
+							   uki_template_cache_entry_t **found);
+uki_template_cache_entry_t* find_cache_entry(const uki_template_table_t *table,
+											 const char *template_name,
+											 const unsigned long hash);
+uki_error insert_cache_entry(uki_template_cache *cache,
+							 const char *template_name,
+							 const unsigned long hash,
+							 const unsigned long ticket,
+							 uki_template_cache_entry_t **found);
+uki_error reload_cache_entry(uki_template_cache *cache,
+							 uki_template_cache_entry_t *entry,
+							 const file_info_t info);
+void insert_template_slot(uki_template_table_t *table,
+						  const unsigned long hash, const size_t index);
+void destroy_compiled_template(void *compiled);
+void destroy_template_table(void *table);
+void destroy_template_entries(void *table);
+void destroy_page_skeleton(void *skeleton);
+uki_error render_nodes(render_state_t *state,
+					   const uki_compiled_template_t *template,
+					   const int depth);
+uki_error resolve_includes(uki_template_cache *cache,
+						   const unsigned long ticket,
+						   const uki_compiled_template_t *template,
+						   bool *has_body, uki_page_skeleton_t *skeleton,
+						   const int depth);
+void push_skeleton_dep(uki_page_skeleton_t *skeleton,
+					   uki_template_cache_entry_t *entry);
+uki_error prepare_page_skeleton(uki_template_cache *cache,
+								const char *template_name,
+								const unsigned long ticket,
+								const uki_variable_container variables,
+								const uki_page_skeleton_t **found);
+void init_render_state(render_state_t *state, uki_template_cache *cache,
+					   const uki_variable_container *variables);
+void emit_text(render_state_t *state, const char *str, const size_t len);
+uki_error emit_article(render_state_t *state, const char *text,
+					   const size_t len);
+uki_error prepare_page(render_state_t *state, const char *template_name,
+					   const char *article_path,
+					   const uki_compiled_template_t **template,
+					   file_view_t *article);
+uki_error emit_page(render_state_t *state,
+					const uki_compiled_template_t *template,
+					const file_view_t *article);
+uki_error collect_template_deps(uki_page_deps_t *deps,
+								uki_template_cache *cache,
+								const unsigned long ticket,
+								const char *template_name, const int depth);
+void push_dependency(char ***list, size_t *size, const char *name,
+					 const size_t len);
+bool find_dependency(char **list, const size_t size, const char *name);
+void push_template_node(arena_t *arena, uki_compiled_template_t *compiled,
+						const uint8_t type, const char *str, const size_t len);
+void populate_template_from_path(const uki_template_container *container,
+								 uki_template_t *template, const char *fpath);
 void push_template(uki_template_container *container, uki_template_t template);
 
 /**
  * Initializes the templating engine.
  *
- * @param container  Template container.
- * @param _wiki_root Path to the root of the uki wiki.
+ * @param container Template container.
+ * @param wiki_root Path to the root of the uki wiki.
  */
 void initialize_templating(uki_template_container *container,
-						   const char *_wiki_root) {
+						   const char *wiki_root) {
 	// Initialize paths.
-	wiki_root_path = _wiki_root;
-	pathcat(2, template_path, wiki_root_path, UKI_TEMPLATE_ROOT);
+	pathcat(2, container->root, wiki_root, UKI_TEMPLATE_ROOT);
 
 	// Initialize the template container.
 	container->size = 0;
-	container->list = malloc(sizeof(uki_template_t));
+	container->list = mem_malloc(sizeof(uki_template_t));
 }
 
 /**
@@ -70,6 +144,7 @@ uki_template_t find_template_i(const size_t index,
 		nl.path = NULL;
 		nl.parent = NULL;
 		nl.deepness = 0;
+		memset(&nl.info, 0, sizeof(file_info_t));
 
 		return nl;
 	}
@@ -84,7 +159,7 @@ uki_template_t find_template_i(const size_t index,
  * @param template  Template structure to be added.
  */
 void push_template(uki_template_container *container, uki_template_t template) {
-	container->list = realloc(container->list, sizeof(uki_template_t) *
+	container->list = mem_realloc(container->list, sizeof(uki_template_t) *
 							  (container->size + 1));
 	container->list[container->size++] = template;
 }
@@ -93,26 +168,28 @@ void push_template(uki_template_container *container, uki_template_t template) {
  * Populates a template structure using a file path.
  * @remark This function ignores the template root path, but it must be present.
  *
- * @param template Template structure to be populated.
- * @param fpath    Complete file path. Template root part will be ignored.
+ * @param container Template container the template belongs to.
+ * @param template  Template structure to be populated.
+ * @param fpath     Complete file path. Template root part will be ignored.
  */
-void populate_template_from_path(uki_template_t *template, const char *fpath) {
+void populate_template_from_path(const uki_template_container *container,
+								 uki_template_t *template, const char *fpath) {
 	const char *reldir = fpath;
 
 	// Skip the template root directory.
-	reldir += strlen(template_path);
+	reldir += strlen(container->root);
 
 	// Allocate memory and populate the structure.
-	template->name = (char*)malloc(basename_noext(NULL, reldir) *
+	template->name = (char*)mem_malloc(basename_noext(NULL, reldir) *
 								   sizeof(char));
-	template->path = (char*)malloc((strlen(reldir) + 1) * sizeof(char));
+	template->path = (char*)mem_malloc((strlen(reldir) + 1) * sizeof(char));
 	basename_noext(template->name, reldir);
 	strcpy(template->path, reldir);
 	template->deepness = path_deepness(template->path);
 
 	// Populate the parent path.
 	if (template->deepness > 0) {
-		template->parent = (char*)malloc(parent_dir_name(NULL, reldir) *
+		template->parent = (char*)mem_malloc(parent_dir_name(NULL, reldir) *
 										 sizeof(char));
 		parent_dir_name(template->parent, reldir);
 	} else {
@@ -125,14 +202,20 @@ void populate_template_from_path(uki_template_t *template, const char *fpath) {
  *
  * @param  container Template container.
  * @param  fpath     Complete path to the template.
+ * @param  info      Template file metadata or NULL to look it up.
  * @return           The recently added template.
  */
 uki_template_t add_template(uki_template_container *container,
-							const char *fpath) {
+							const char *fpath, const file_info_t *info) {
 	uki_template_t template;
 
 	// Populate template and push it into the container.
-	populate_template_from_path(&template, fpath);
+	populate_template_from_path(container, &template, fpath);
+	if (info != NULL) {
+		template.info = *info;
+	} else if (!file_info(&template.info, fpath)) {
+		memset(&template.info, 0, sizeof(file_info_t));
+	}
 	push_template(container, template);
 
 	return template;
@@ -142,23 +225,27 @@ uki_template_t add_template(uki_template_container *container,
  * Populates the templates container.
  *
  * @param  container Template container.
+ * @param  nthreads  Number of threads scanning the folder. 1 scans it
+ *                   serially.
  * @return           UKI_OK if the operation was successful.
  */
-uki_error populate_templates(uki_template_container *container) {
+uki_error populate_templates(uki_template_container *container,
+							 const size_t nthreads) {
 	dirlist_t dirlist;
 	uki_error err;
 	size_t i;
 
 	// Go through the directory and sort the findings.
 	dirlist.size = 0;
-	if ((err = list_directory_files(&dirlist, template_path, true)) != UKI_OK)
+	err = list_directory_files_parallel(&dirlist, container->root, nthreads);
+	if (err != UKI_OK)
 		return err;
 	sort_dirlist(&dirlist);
 
 	// Push the files into the template container.
 	for (i = 0; i < dirlist.size; i++) {
 		if (file_ext_match(dirlist.list[i], UKI_TEMPLATE_EXT))
-			add_template(container, dirlist.list[i]);
+			add_template(container, dirlist.list[i], &dirlist.info[i]);
 	}
 
 	// Clean up and return.
@@ -166,6 +253,36 @@ uki_error populate_templates(uki_template_container *container) {
 	return UKI_OK;
 }
 
+/**
+ * Makes a copy of a template container that can be changed without disturbing
+ * anyone still reading the original.
+ * @remark The copy shares the template strings with the original, so only
+ *         one of them can be freed with free_templates(). The other one must
+ *         be released with release_templates().
+ *
+ * @param clone     Template container to be populated.
+ * @param container Template container to be copied.
+ */
+void clone_templates(uki_template_container *clone,
+					 const uki_template_container *container) {
+	strcpy(clone->root, container->root);
+	clone->size = container->size;
+	clone->list = mem_malloc(sizeof(uki_template_t) * ((clone->size > 0) ?
+							 clone->size : 1));
+	memcpy(clone->list, container->list, sizeof(uki_template_t) * clone->size);
+}
+
+/**
+ * Frees a template container without freeing the template strings it shares
+ * with its clones.
+ *
+ * @param container Template container to be released.
+ */
+void release_templates(uki_template_container container) {
+	mem_free(container.list);
+	container.size = 0;
+}
+
 /**
  * Cleans up the mess we left behind.
  *
@@ -174,179 +291,1451 @@ uki_error populate_templates(uki_template_container *container) {
 void free_templates(uki_template_container container) {
 	size_t i;
 	for (i = 0; i < container.size; i++) {
-		free(container.list[i].path);
-		free(container.list[i].name);
-		free(container.list[i].parent);
+		mem_free(container.list[i].path);
+		mem_free(container.list[i].name);
+		mem_free(container.list[i].parent);
 	}
 
-	free(container.list);
+	mem_free(container.list);
 	container.size = 0;
 }
 
 /**
- * Substitutes template references found inside a template.
+ * Pushes a node into a compiled template that's being built in an arena.
  *
- * @param  template Template file contents.
- * @return          UKI_OK when all the substitutions were successful.
+ * @param arena    Arena the node list is being built in.
+ * @param compiled Compiled template.
+ * @param type     Type of the node.
+ * @param str      Text of the node (pointing inside the template source). Tag
+ *                 names must already be NULL terminated.
+ * @param len      Length of the text.
+ */
+void push_template_node(arena_t *arena, uki_compiled_template_t *compiled,
+						const uint8_t type, const char *str, const size_t len) {
+	uki_template_node_t *node;
+
+	// Grow the node list if needed.
+	if (compiled->size == compiled->capacity) {
+		size_t oldcap = compiled->capacity;
+		compiled->capacity = (compiled->capacity == 0) ? 16 :
+			compiled->capacity * 2;
+		compiled->nodes = arena_grow(arena, compiled->nodes,
+									 sizeof(uki_template_node_t) * oldcap,
+									 sizeof(uki_template_node_t) *
+									 compiled->capacity);
+	}
+
+	// Populate the node.
+	node = &compiled->nodes[compiled->size++];
+	node->type = type;
+	node->str = str;
+	node->len = len;
+	node->hash = (type == TEMPLATE_NODE_VARIABLE) ? strhash(str) : 0;
+
+	// Keep track of the body placement.
+	if (type == TEMPLATE_NODE_BODY)
+		compiled->has_body = true;
+}
+
+/**
+ * Compiles a template text into a flat list of literal spans and tags.
+ * @remark The text is owned by the compiled template after this call and the
+ *         closing delimiter of every tag is replaced by a NULL terminator, so
+ *         tag nodes can be used directly as strings.
+ *
+ * @param  compiled Compiled template to be populated.
+ * @param  text     Text to be compiled. (Allocated with mem_malloc)
+ * @return          UKI_OK if the compilation was successful.
+ */
+uki_error compile_text(uki_compiled_template_t *compiled, char *text) {
+	arena_t *arena = render_arena();
+	char *cursor;
+	char *start;
+
+	// Initialize the compiled template.
+	compiled->source = text;
+	compiled->has_body = false;
+	compiled->size = 0;
+	compiled->capacity = 0;
+	compiled->nodes = NULL;
+
+	// Go through the text looking for tags.
+	arena_begin(arena);
+	start = text;
+	while ((cursor = strpbrk(start, "[%")) != NULL) {
+		char close;
+		char *end;
+		uint8_t type;
+
+		// Find the end of the tag.
+		close = (*cursor == TEMPLATE_INCLUDE_BEGIN) ? TEMPLATE_INCLUDE_END :
+			TEMPLATE_VAR_DELIM;
+		end = strchr(cursor + 1, close);
+		if ((end == NULL) || (end == (cursor + 1)) ||
+				((end - cursor - 1) >= TEMPLATE_TAG_MAX_CHAR)) {
+			compiled->nodes = NULL;
+			free_compiled_template(compiled);
+			arena_end(arena);
+
+			return UKI_ERROR_PARSING_TEMPLATE;
+		}
+
+		// Push the literal text before the tag.
+		if (cursor > start)
+			push_template_node(arena, compiled, TEMPLATE_NODE_TEXT, start,
+							   cursor - start);
+
+		// Terminate the tag name and figure out its type.
+		*end = '\0';
+		if (close == TEMPLATE_INCLUDE_END) {
+			type = TEMPLATE_NODE_INCLUDE;
+		} else if (strcmp(cursor + 1, TEMPLATE_BODY_VAR) == 0) {
+			type = TEMPLATE_NODE_BODY;
+		} else {
+			type = TEMPLATE_NODE_VARIABLE;
+		}
+
+		// Push the tag and move past it.
+		push_template_node(arena, compiled, type, cursor + 1,
+						   end - cursor - 1);
+		start = end + 1;
+	}
+
+	// Push the remaining literal text.
+	if (*start != '\0')
+		push_template_node(arena, compiled, TEMPLATE_NODE_TEXT, start,
+						   strlen(start));
+
+	// Move the node list out of the arena.
+	if (compiled->size > 0) {
+		compiled->nodes = arena_detach(compiled->nodes,
+									   sizeof(uki_template_node_t) *
+									   compiled->size);
+	}
+	compiled->capacity = compiled->size;
+	arena_end(arena);
+
+	return UKI_OK;
+}
+
+/**
+ * Frees a compiled template.
+ *
+ * @param compiled Compiled template to be freed.
+ */
+void free_compiled_template(uki_compiled_template_t *compiled) {
+	mem_free(compiled->nodes);
+	mem_free(compiled->source);
+	compiled->nodes = NULL;
+	compiled->source = NULL;
+	compiled->size = 0;
+	compiled->capacity = 0;
+}
+
+/**
+ * Initializes the compiled templates cache.
+ * @remark Lookups never take a lock. Only loading a template that isn't there
+ *         yet or has changed does, and the replaced templates are retired into
+ *         the reclamation domain, so every lookup must be done inside one of
+ *         its read sections.
+ *
+ * @param cache     Template cache.
+ * @param wiki_root Path to the root of the uki wiki.
+ * @param mode      UKI_CACHE_VALIDATE to check the template files for changes
+ *                  on every lookup, UKI_CACHE_FROZEN to never look at them
+ *                  again or UKI_CACHE_BACKGROUND to leave it to
+ *                  refresh_template_cache().
+ * @param reclaim   Reclamation domain the replaced templates are retired into.
+ */
+void initialize_template_cache(uki_template_cache *cache,
+							   const char *wiki_root, const uint8_t mode,
+							   epoch_domain_t *reclaim) {
+	pathcat(2, cache->root, wiki_root, UKI_TEMPLATE_ROOT);
+	cache->mode = mode;
+	cache->skeleton_enabled = false;
+	cache->renders = 0;
+	cache->generation = 0;
+	cache->reclaim = reclaim;
+	cache->table = NULL;
+	cache->skeleton = NULL;
+	mutex_init(&cache->lock);
+}
+
+/**
+ * Reads a template file from disk and compiles it.
+ *
+ * @param  cache         Template cache.
+ * @param  template_name The template file to be loaded.
+ * @param  compiled      Newly compiled template or NULL if it couldn't be
+ *                       loaded. (Free with destroy_compiled_template())
+ * @return               UKI_OK if the template was loaded successfully.
  */
-uki_error substitute_templates(char **template) {
-	char fname[UKI_MAX_TEMPLATE_NAME];
-	char *ntemp;
+uki_error load_template(const uki_template_cache *cache,
+						const char *template_name,
+						uki_compiled_template_t **compiled) {
+	char path[UKI_MAX_PATH];
+	file_info_t info;
+	char *contents;
 	uki_error err;
-	int nmatches;
 
-	// Try to find a template tag.
-	nmatches = sscanf(*template, TEMPLATE_FILE_MATCH, fname);
-	if (nmatches == 1) {
-		// Get template file contents.
-		if ((err = render_template(&ntemp, fname)) != UKI_OK) {
-			return err;
+	// Build template path.
+	*compiled = NULL;
+	pathcat(2, path, cache->root, template_name);
+	extcat(path, UKI_TEMPLATE_EXT);
+
+	// Slurp file, checking why it failed only if it did.
+	slurp_file_info(&contents, &info, path);
+	if (contents == NULL) {
+		return file_exists(path) ? UKI_ERROR_READING_TEMPLATE :
+			UKI_ERROR_NOTEMPLATE;
+	}
+
+	// Compile the template.
+	*compiled = (uki_compiled_template_t*)mem_malloc(
+		sizeof(uki_compiled_template_t));
+	if ((err = compile_text(*compiled, contents)) != UKI_OK) {
+		mem_free(*compiled);
+		*compiled = NULL;
+
+		return err;
+	}
+	(*compiled)->info = info;
+
+	return UKI_OK;
+}
+
+/**
+ * Gets a compiled template from the cache, loading it from disk if it isn't
+ * there yet or if its file has changed since it was last loaded.
+ *
+ * @param  cache         Template cache.
+ * @param  template_name The template file to be looked up.
+ * @param  ticket        Ticket of the render doing the lookup.
+ * @param  compiled      Compiled template. (Owned by the cache and valid until
+ *                       the read section is left)
+ * @return               UKI_OK if the template is available.
+ */
+uki_error template_cache_get(uki_template_cache *cache,
+							 const char *template_name,
+							 const unsigned long ticket,
+							 const uki_compiled_template_t **compiled) {
+	uki_template_cache_entry_t *entry;
+	uki_error err;
+
+	if ((err = template_cache_entry(cache, template_name, ticket,
+									&entry)) != UKI_OK)
+		return err;
+
+	*compiled = sync_load_ptr(&entry->compiled);
+	return UKI_OK;
+}
+
+/**
+ * Gets a template cache entry, loading it from disk if it isn't there yet or if
+ * its file has changed since it was last loaded. Each template is only checked
+ * for changes once per render ticket.
+ * @remark Cache entries stay at the same address until the cache is flushed.
+ *
+ * @param  cache         Template cache.
+ * @param  template_name The template file to be looked up.
+ * @param  ticket        Ticket of the render doing the lookup.
+ * @param  found         Cache entry of the template. (Owned by the cache)
+ * @return               UKI_OK if the template is available.
+ */
+uki_error template_cache_entry(uki_template_cache *cache,
+							   const char *template_name,
+							   const unsigned long ticket,
+							   uki_template_cache_entry_t **found) {
+	const uki_compiled_template_t *compiled;
+	uki_template_cache_entry_t *entry;
+	unsigned long hash;
+	uki_error err;
+
+	// Look for the template in the cache.
+	hash = strhash(template_name);
+	entry = find_cache_entry(sync_load_ptr(&cache->table), template_name, hash);
+	if (entry == NULL)
+		return insert_cache_entry(cache, template_name, hash, ticket, found);
+
+	// Check if the file has changed since we've last seen it.
+	if ((sync_load(&cache->mode) == UKI_CACHE_VALIDATE) &&
+			(sync_load(&entry->checked) != ticket)) {
+		char path[UKI_MAX_PATH];
+		file_info_t info;
+
+		pathcat(2, path, cache->root, template_name);
+		extcat(path, UKI_TEMPLATE_EXT);
+		if (!file_info(&info, path))
+			return UKI_ERROR_NOTEMPLATE;
+
+		compiled = sync_load_ptr(&entry->compiled);
+		if (file_info_changed(info, compiled->info)) {
+			if ((err = reload_cache_entry(cache, entry, info)) != UKI_OK)
+				return err;
 		}
 
-		// If found, replace it.
-		replace_string(template, fname, ntemp, SUBSTITUTE_TEMPLATE);
-		free(ntemp);
+		sync_store(&entry->checked, ticket);
+	}
+
+	*found = entry;
+	return UKI_OK;
+}
+
+/**
+ * Looks for a template in a cache table.
+ *
+ * @param  table         Cache table. (Can be NULL)
+ * @param  template_name The template file to be looked up.
+ * @param  hash          Hash of the template name.
+ * @return               Cache entry of the template or NULL if it isn't there.
+ */
+uki_template_cache_entry_t* find_cache_entry(const uki_template_table_t *table,
+											 const char *template_name,
+											 const unsigned long hash) {
+	uki_template_cache_entry_t *entry;
+	size_t mask;
+	size_t i;
+
+	if (table == NULL)
+		return NULL;
+
+	// Linear probing until we hit an empty slot.
+	mask = table->nslots - 1;
+	i = hash & mask;
+	while (table->slots[i].index != 0) {
+		entry = table->list[table->slots[i].index - 1];
+		if ((table->slots[i].hash == hash) &&
+				(strcmp(entry->name, template_name) == 0))
+			return entry;
+
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+/**
+ * Inserts an entry index into the first free slot of a cache table.
+ *
+ * @param table Cache table that's still being put together.
+ * @param hash  Hash of the template name.
+ * @param index Index of the entry in the list.
+ */
+void insert_template_slot(uki_template_table_t *table,
+						  const unsigned long hash, const size_t index) {
+	size_t mask = table->nslots - 1;
+	size_t i = hash & mask;
+
+	// Linear probing until we find a free slot.
+	while (table->slots[i].index != 0)
+		i = (i + 1) & mask;
+
+	table->slots[i].hash = hash;
+	table->slots[i].index = index + 1;
+}
+
+/**
+ * Loads a template into a new cache entry and publishes a new cache table with
+ * it in there.
+ *
+ * @param  cache         Template cache.
+ * @param  template_name The template file to be loaded.
+ * @param  hash          Hash of the template name.
+ * @param  ticket        Ticket of the render doing the lookup.
+ * @param  found         Cache entry of the template. (Owned by the cache)
+ * @return               UKI_OK if the template was loaded successfully.
+ */
+uki_error insert_cache_entry(uki_template_cache *cache,
+							 const char *template_name,
+							 const unsigned long hash,
+							 const unsigned long ticket,
+							 uki_template_cache_entry_t **found) {
+	uki_template_cache_entry_t *entry;
+	uki_template_table_t *table;
+	uki_template_table_t *grown;
+	uki_error err;
+	size_t i;
+
+	// Someone else might have loaded it while we waited for the lock.
+	mutex_lock(&cache->lock);
+	table = cache->table;
+	if ((entry = find_cache_entry(table, template_name, hash)) != NULL) {
+		mutex_unlock(&cache->lock);
+		*found = entry;
 
-		// Continue until we don't have any one left.
-		if (substitute_templates(template) == UKI_OK)
-			return UKI_OK;
-#ifdef WINDOWS
-	} else if ((nmatches == EOF) || (nmatches == 0)) {
-#else
-	} else if (nmatches == EOF) {
-#endif
-		// Finished substituting the templates.
 		return UKI_OK;
 	}
 
-	// Looks like we finally don't have any tags left.
-	return UKI_ERROR_PARSING_TEMPLATE;
+	// Load the template into a new entry.
+	entry = (uki_template_cache_entry_t*)mem_malloc(
+		sizeof(uki_template_cache_entry_t));
+	entry->name = (char*)mem_malloc((strlen(template_name) + 1) * sizeof(char));
+	strcpy(entry->name, template_name);
+	entry->hash = hash;
+	entry->checked = ticket;
+	if ((err = load_template(cache, template_name,
+							 &entry->compiled)) != UKI_OK) {
+		mutex_unlock(&cache->lock);
+		mem_free(entry->name);
+		mem_free(entry);
+
+		return err;
+	}
+
+	// Publish a copy of the table with the new entry in it.
+	grown = (uki_template_table_t*)mem_malloc(sizeof(uki_template_table_t));
+	grown->size = (table == NULL) ? 1 : table->size + 1;
+	grown->list = (uki_template_cache_entry_t**)mem_malloc(
+		sizeof(uki_template_cache_entry_t*) * grown->size);
+	if (table != NULL) {
+		memcpy(grown->list, table->list,
+			   sizeof(uki_template_cache_entry_t*) * table->size);
+	}
+	grown->list[grown->size - 1] = entry;
+
+	// Index it, keeping the hash table at most 3/4 full.
+	grown->nslots = (table == NULL) ? TEMPLATE_INITIAL_SLOTS : table->nslots;
+	if ((grown->size * 4) > (grown->nslots * 3))
+		grown->nslots *= 2;
+	grown->slots = (uki_template_slot_t*)mem_calloc(grown->nslots,
+		sizeof(uki_template_slot_t));
+	if ((table != NULL) && (grown->nslots == table->nslots)) {
+		memcpy(grown->slots, table->slots,
+			   sizeof(uki_template_slot_t) * table->nslots);
+		insert_template_slot(grown, hash, grown->size - 1);
+	} else {
+		for (i = 0; i < grown->size; i++)
+			insert_template_slot(grown, grown->list[i]->hash, i);
+	}
+	sync_store_ptr(&cache->table, grown);
+	epoch_retire(cache->reclaim, table, destroy_template_table);
+	mutex_unlock(&cache->lock);
+
+	*found = entry;
+	return UKI_OK;
 }
 
 /**
- * Renders a page template and returns it.
+ * Reloads a template that has changed on disk and publishes the newly compiled
+ * version into its cache entry.
  *
- * @param  rendered      The final rendered page. Allocated by this function.
- * @param  template_name The template file to be rendered.
- * @return               UKI_OK if the rendering went smoothly.
+ * @param  cache Template cache.
+ * @param  entry Cache entry of the template.
+ * @param  info  Current metadata of the template file.
+ * @return       UKI_OK if the template was reloaded successfully.
  */
-uki_error render_template(char **rendered, const char *template_name) {
-	// Build template path.
-	char template_path[UKI_MAX_PATH];
-	pathcat(3, template_path, wiki_root_path, UKI_TEMPLATE_ROOT, template_name);
-	extcat(template_path, UKI_TEMPLATE_EXT);
+uki_error reload_cache_entry(uki_template_cache *cache,
+							 uki_template_cache_entry_t *entry,
+							 const file_info_t info) {
+	uki_compiled_template_t *compiled;
+	uki_error err = UKI_OK;
+
+	// Someone else might have reloaded it while we waited for the lock.
+	mutex_lock(&cache->lock);
+	if (file_info_changed(info, entry->compiled->info)) {
+		if ((err = load_template(cache, entry->name, &compiled)) == UKI_OK) {
+			epoch_retire(cache->reclaim, entry->compiled,
+						 destroy_compiled_template);
+			sync_store_ptr(&entry->compiled, compiled);
+		}
+	}
+	mutex_unlock(&cache->lock);
+
+	return err;
+}
+
+/**
+ * Checks every template in the cache for changes and reloads the ones that
+ * have changed. Renders keep using the old version of a template until the
+ * new one has been compiled and swapped in.
+ * @remark Must be called inside a read section of the cache's reclamation
+ *         domain.
+ *
+ * @param  cache Template cache.
+ * @return       Number of templates that were reloaded.
+ */
+size_t refresh_template_cache(uki_template_cache *cache) {
+	char path[UKI_MAX_PATH];
+	const uki_compiled_template_t *compiled;
+	uki_template_table_t *table;
+	file_info_t info;
+	size_t reloaded = 0;
+	size_t i;
+
+	if ((table = sync_load_ptr(&cache->table)) == NULL)
+		return 0;
+
+	for (i = 0; i < table->size; i++) {
+		pathcat(2, path, cache->root, table->list[i]->name);
+		extcat(path, UKI_TEMPLATE_EXT);
+
+		// Templates that went missing are kept until they are back.
+		compiled = sync_load_ptr(&table->list[i]->compiled);
+		if (!file_info(&info, path) || !file_info_changed(info, compiled->info))
+			continue;
+
+		if (reload_cache_entry(cache, table->list[i], info) == UKI_OK)
+			reloaded++;
+	}
+
+	return reloaded;
+}
+
+/**
+ * Throws away all the compiled templates and the page skeleton. They are only
+ * freed once the renders that might still be using them are done.
+ *
+ * @param cache Template cache to be emptied.
+ */
+void flush_template_cache(uki_template_cache *cache) {
+	uki_template_table_t *table;
+	uki_page_skeleton_t *skeleton;
+
+	mutex_lock(&cache->lock);
+	table = cache->table;
+	skeleton = cache->skeleton;
+	sync_store_ptr(&cache->table, NULL);
+	sync_store_ptr(&cache->skeleton, NULL);
+	sync_add(&cache->generation, 1);
+
+	// The skeleton references the entries, so they must go together.
+	epoch_retire(cache->reclaim, skeleton, destroy_page_skeleton);
+	epoch_retire(cache->reclaim, table, destroy_template_entries);
+	mutex_unlock(&cache->lock);
+}
+
+/**
+ * Frees everything held by the template cache.
+ * @remark Nobody can be using the cache anymore when this is called.
+ *
+ * @param cache Template cache to be freed.
+ */
+void free_template_cache(uki_template_cache *cache) {
+	destroy_page_skeleton(cache->skeleton);
+	destroy_template_entries(cache->table);
+	cache->skeleton = NULL;
+	cache->table = NULL;
+	mutex_destroy(&cache->lock);
+}
+
+/**
+ * Frees a compiled template allocated by load_template().
+ *
+ * @param compiled Compiled template to be freed.
+ */
+void destroy_compiled_template(void *compiled) {
+	free_compiled_template((uki_compiled_template_t*)compiled);
+	mem_free(compiled);
+}
+
+/**
+ * Frees a cache table, leaving the entries in it alone.
+ *
+ * @param table Cache table to be freed. (Can be NULL)
+ */
+void destroy_template_table(void *table) {
+	if (table == NULL)
+		return;
+
+	mem_free(((uki_template_table_t*)table)->list);
+	mem_free(((uki_template_table_t*)table)->slots);
+	mem_free(table);
+}
+
+/**
+ * Frees a cache table along with all of its entries.
+ *
+ * @param table Cache table to be freed. (Can be NULL)
+ */
+void destroy_template_entries(void *table) {
+	uki_template_table_t *tbl = (uki_template_table_t*)table;
+	size_t i;
+
+	if (tbl == NULL)
+		return;
+
+	for (i = 0; i < tbl->size; i++) {
+		destroy_compiled_template(tbl->list[i]->compiled);
+		mem_free(tbl->list[i]->name);
+		mem_free(tbl->list[i]);
+	}
+
+	destroy_template_table(tbl);
+}
+
+/**
+ * Makes sure all the templates included by a template are available and checks
+ * if any of them has a body tag.
+ *
+ * @param  cache    Template cache.
+ * @param  ticket   Ticket of the render doing the lookups.
+ * @param  template Compiled template.
+ * @param  has_body Set to TRUE if there's a body tag somewhere in there.
+ * @param  skeleton Page skeleton to record the included templates into or
+ *                  NULL if they shouldn't be recorded.
+ * @param  depth    Current include depth.
+ * @return          UKI_OK if all the included templates are available.
+ */
+uki_error resolve_includes(uki_template_cache *cache,
+						   const unsigned long ticket,
+						   const uki_compiled_template_t *template,
+						   bool *has_body, uki_page_skeleton_t *skeleton,
+						   const int depth) {
+	uki_template_cache_entry_t *include;
+	uki_error err;
+	size_t i;
+
+	// Guard against templates that include themselves.
+	if (depth > TEMPLATE_MAX_DEPTH)
+		return UKI_ERROR_PARSING_TEMPLATE;
+
+	if (template->has_body)
+		*has_body = true;
+
+	for (i = 0; i < template->size; i++) {
+		if (template->nodes[i].type != TEMPLATE_NODE_INCLUDE)
+			continue;
+
+		if ((err = template_cache_entry(cache, template->nodes[i].str, ticket,
+										&include)) != UKI_OK)
+			return err;
+		if (skeleton != NULL)
+			push_skeleton_dep(skeleton, include);
+		if ((err = resolve_includes(cache, ticket,
+									sync_load_ptr(&include->compiled),
+									has_body, skeleton,
+									depth + 1)) != UKI_OK)
+			return err;
+	}
+
+	return UKI_OK;
+}
+
+/**
+ * Renders a compiled template by walking its nodes and appending each piece
+ * to the output buffer.
+ *
+ * @param  out       String builder to render into.
+ * @param  cache     Template cache to fetch the included templates from.
+ * @param  template  Compiled template to be rendered.
+ * @param  body      Article to be placed in the body tag or NULL.
+ * @param  variables Variables container.
+ * @return           UKI_OK when all the substitutions were successful.
+ */
+uki_error render_compiled_template(strbuf_t *out, uki_template_cache *cache,
+								   const uki_compiled_template_t *template,
+								   const file_view_t *body,
+								   const uki_variable_container variables) {
+	render_state_t state;
+
+	init_render_state(&state, cache, &variables);
+	state.out = out;
+	state.body = body;
+
+	return render_nodes(&state, template, 0);
+}
+
+/**
+ * Initializes a rendering state.
+ *
+ * @param state     Rendering state.
+ * @param cache     Template cache to fetch the included templates from.
+ * @param variables Variables container.
+ */
+void init_render_state(render_state_t *state, uki_template_cache *cache,
+					   const uki_variable_container *variables) {
+	state->arena = render_arena();
+	state->out = NULL;
+	state->iov = NULL;
+	state->cache = cache;
+	state->skeleton = NULL;
+	state->variables = variables;
+	state->body = NULL;
+	state->split = false;
+	state->nbodies = 0;
+	state->body_pos = 0;
+
+	// Get a new ticket so each template is only checked once per render.
+	state->ticket = 0;
+	if (sync_load(&cache->mode) == UKI_CACHE_VALIDATE)
+		state->ticket = sync_add(&cache->renders, 1);
+}
 
-	// Check if there is a template there.
-	if (!file_exists(template_path))
-		return UKI_ERROR_NOTEMPLATE;
+/**
+ * Emits a piece of the rendered page, either by appending it to the output
+ * buffer or by pointing a new segment at it.
+ *
+ * @param state Rendering state.
+ * @param str   Piece of text to be emitted.
+ * @param len   Length of the text.
+ */
+void emit_text(render_state_t *state, const char *str, const size_t len) {
+	uki_page_iov_t *iov = state->iov;
 
-	// Slurp file.
-	slurp_file(rendered, template_path);
-	if (*rendered == NULL)
-		return UKI_ERROR_READING_TEMPLATE;
+	if (iov == NULL) {
+		strbuf_append(state->out, str, len);
+		return;
+	}
+
+	// Ignore empty segments.
+	if (len == 0)
+		return;
+
+	// Grow the segment list if needed.
+	if (iov->size == iov->capacity) {
+		size_t oldcap = iov->capacity;
+		iov->capacity = (iov->capacity == 0) ? 32 : iov->capacity * 2;
+		iov->list = arena_grow(state->arena, iov->list,
+							   sizeof(uki_iovec_t) * oldcap,
+							   sizeof(uki_iovec_t) * iov->capacity);
+	}
 
-	// Render the template and return.
-	return substitute_templates(rendered);
+	iov->list[iov->size].iov_base = (void*)str;
+	iov->list[iov->size].iov_len = len;
+	iov->size++;
+	iov->len += len;
 }
 
 /**
- * Substitutes variable references found inside a template.
+ * Renders the nodes of a compiled template keeping track of how deep in the
+ * includes we are.
  *
- * @param  filled_template Template contents already all populated.
- * @param  variables       Variables container.
- * @return                 UKI_OK when all the substitutions were successful.
+ * @param  state    Rendering state.
+ * @param  template Compiled template to be rendered.
+ * @param  depth    Current include depth.
+ * @return          UKI_OK when all the substitutions were successful.
  */
-int render_variables(char **filled_template,
-					 const uki_variable_container variables) {
-	char vname[VARIABLE_KEY_MAX_CHAR];
-	int ivar;
-	int nmatches;
+uki_error render_nodes(render_state_t *state,
+					   const uki_compiled_template_t *template,
+					   const int depth) {
+	const uki_compiled_template_t *include;
+	const file_view_t *body;
+	const uki_template_node_t *node;
 	uki_error err;
+	ssize_t ivar;
+	size_t i;
+
+	// Guard against templates that include themselves.
+	if (depth > TEMPLATE_MAX_DEPTH)
+		return UKI_ERROR_PARSING_TEMPLATE;
+
+	for (i = 0; i < template->size; i++) {
+		node = &template->nodes[i];
+
+		switch (node->type) {
+		case TEMPLATE_NODE_TEXT:
+			emit_text(state, node->str, node->len);
+			break;
+		case TEMPLATE_NODE_INCLUDE:
+			if ((err = template_cache_get(state->cache, node->str,
+										  state->ticket, &include)) != UKI_OK)
+				return err;
+			if ((err = render_nodes(state, include, depth + 1)) != UKI_OK)
+				return err;
+			break;
+		case TEMPLATE_NODE_BODY:
+			// Just take note of where the body goes if we are splitting.
+			if (state->split) {
+				if (state->nbodies++ == 0)
+					state->body_pos = state->out->len;
+				break;
+			}
+
+			if (state->body == NULL)
+				return UKI_ERROR_BODYVAR_NOTFOUND;
+
+			// Render the body making sure it can't recurse into itself.
+			body = state->body;
+			state->body = NULL;
+			err = emit_article(state, body->data, body->size);
+			state->body = body;
+			if (err != UKI_OK)
+				return err;
+			break;
+		case TEMPLATE_NODE_VARIABLE:
+			// Get variable contents.
+			if ((ivar = find_variable_h(node->str, node->hash,
+										*state->variables)) < 0)
+				return UKI_ERROR_VARIABLE_NOTFOUND;
+
+			emit_text(state, state->variables->list[ivar].value,
+					  strlen(state->variables->list[ivar].value));
+			break;
+		}
+	}
+
+	return UKI_OK;
+}
+
+/**
+ * Emits an article substituting the variables found in it.
+ *
+ * @param  state Rendering state.
+ * @param  text  Article contents. (Doesn't need to be NULL terminated)
+ * @param  len   Length of the article contents.
+ * @return       UKI_OK when all the substitutions were successful.
+ */
+uki_error emit_article(render_state_t *state, const char *text,
+					   const size_t len) {
+	const char *end = text + len;
+	const char *cursor = text;
+	const char *tag;
+	const char *close;
+	char vname[TEMPLATE_TAG_MAX_CHAR];
+	ssize_t ivar;
+
+	// Go through the article looking for variable tags.
+	while ((tag = memchr(cursor, TEMPLATE_VAR_DELIM, end - cursor)) != NULL) {
+		// Find the end of the tag.
+		close = memchr(tag + 1, TEMPLATE_VAR_DELIM, end - tag - 1);
+		if ((close == NULL) || (close == (tag + 1)) ||
+				((close - tag - 1) >= TEMPLATE_TAG_MAX_CHAR))
+			return UKI_ERROR_PARSING_TEMPLATE;
+
+		// Get the variable name.
+		memcpy(vname, tag + 1, close - tag - 1);
+		vname[close - tag - 1] = '\0';
 
-	// Try to find a variable tag.
-	nmatches = sscanf(*filled_template, TEMPLATE_VAR_MATCH, vname);
-	if (nmatches == 1) {
 		// Get variable contents.
-		if ((ivar = find_variable(vname, variables)) < 0) {
-			//fprintf(stderr, "WARNING: Couldn't find variable '%s'.\n", vname);
+		if ((ivar = find_variable(vname, *state->variables)) < 0)
 			return UKI_ERROR_VARIABLE_NOTFOUND;
+
+		// Emit the text before the tag and the variable in its place.
+		emit_text(state, cursor, tag - cursor);
+		emit_text(state, state->variables->list[ivar].value,
+				  strlen(state->variables->list[ivar].value));
+		cursor = close + 1;
+	}
+
+	// Emit the remaining text.
+	emit_text(state, cursor, end - cursor);
+	return UKI_OK;
+}
+
+/**
+ * Pushes a template the page skeleton depends on into its list.
+ *
+ * @param skeleton Page skeleton.
+ * @param entry    Template cache entry the skeleton depends on.
+ */
+void push_skeleton_dep(uki_page_skeleton_t *skeleton,
+					   uki_template_cache_entry_t *entry) {
+	const uki_compiled_template_t *compiled = sync_load_ptr(&entry->compiled);
+
+	skeleton->deps = mem_realloc(skeleton->deps,
+							 sizeof(uki_template_cache_entry_t*) *
+							 (skeleton->ndeps + 1));
+	skeleton->deps_info = mem_realloc(skeleton->deps_info, sizeof(file_info_t) *
+								  (skeleton->ndeps + 1));
+	skeleton->deps[skeleton->ndeps] = entry;
+	skeleton->deps_info[skeleton->ndeps++] = compiled->info;
+}
+
+/**
+ * Makes sure the page skeleton is built for a template and is up to date with
+ * the template files it was built from. A new skeleton is built without
+ * holding any locks and then swapped in for the old one.
+ *
+ * @param  cache         Template cache holding the skeleton.
+ * @param  template_name The template file to place the articles into.
+ * @param  ticket        Ticket of the render doing the lookups.
+ * @param  variables     Variables container.
+ * @param  found         Page skeleton. (Valid until the read section is left)
+ * @return               UKI_OK if the templates could be loaded.
+ */
+uki_error prepare_page_skeleton(uki_template_cache *cache,
+								const char *template_name,
+								const unsigned long ticket,
+								const uki_variable_container variables,
+								const uki_page_skeleton_t **found) {
+	const uki_compiled_template_t *compiled;
+	uki_template_cache_entry_t *entry;
+	uki_page_skeleton_t *skeleton;
+	uki_page_skeleton_t *built;
+	unsigned long generation;
+	render_state_t state;
+	bool has_body;
+	strbuf_t out;
+	uki_error err;
+	size_t i;
+
+	// Check if the skeleton we have is still good.
+	generation = sync_load(&cache->generation);
+	skeleton = sync_load_ptr(&cache->skeleton);
+	if ((skeleton != NULL) &&
+			(strcmp(skeleton->template_name, template_name) == 0)) {
+		*found = skeleton;
+		if (sync_load(&cache->mode) == UKI_CACHE_FROZEN)
+			return UKI_OK;
+
+		for (i = 0; i < skeleton->ndeps; i++) {
+			if ((err = template_cache_entry(cache, skeleton->deps[i]->name,
+											ticket, &entry)) != UKI_OK)
+				return err;
+
+			compiled = sync_load_ptr(&entry->compiled);
+			if (file_info_changed(compiled->info, skeleton->deps_info[i]))
+				break;
 		}
 
-		// If found, replace it.
-		replace_string(filled_template, vname,
-					   variables.list[ivar].value, SUBSTITUTE_VARIABLE);
+		if (i == skeleton->ndeps)
+			return UKI_OK;
+	}
 
-		// Continue until we don't have any one left.
-		err = render_variables(filled_template, variables);
-		if ((err == UKI_OK) || (err ==  UKI_ERROR_VARIABLE_NOTFOUND))
-			return err;
-#ifdef WINDOWS
-	} else if ((nmatches == EOF) || (nmatches == 0)) {
-#else
-	} else if (nmatches == EOF) {
-#endif
-		// Finished substituting the templates.
-		return UKI_OK;
+	// Start over and gather all the templates we depend on.
+	built = (uki_page_skeleton_t*)mem_calloc(1, sizeof(uki_page_skeleton_t));
+	if ((err = template_cache_entry(cache, template_name, ticket,
+									&entry)) != UKI_OK) {
+		destroy_page_skeleton(built);
+		return err;
+	}
+	push_skeleton_dep(built, entry);
+	has_body = false;
+	if ((err = resolve_includes(cache, ticket, sync_load_ptr(&entry->compiled),
+								&has_body, built, 0)) != UKI_OK) {
+		destroy_page_skeleton(built);
+		return err;
 	}
 
-	// Looks like we finally don't have any tags left.
-	return UKI_ERROR_PARSING_TEMPLATE;
+	// Expand the whole template splitting it at the body tag.
+	init_render_state(&state, cache, &variables);
+	state.ticket = ticket;
+	arena_begin(state.arena);
+	strbuf_init_arena(&out, state.arena, TEMPLATE_RENDER_SLACK);
+	state.out = &out;
+	state.split = true;
+	built->status = render_nodes(&state, sync_load_ptr(&entry->compiled), 0);
+
+	// Populate the skeleton.
+	built->template_name = (char*)mem_malloc((strlen(template_name) + 1) *
+											 sizeof(char));
+	strcpy(built->template_name, template_name);
+	built->nbodies = state.nbodies;
+	built->split = state.body_pos;
+	built->len = out.len;
+	built->page = strbuf_detach(&out);
+	arena_end(state.arena);
+
+	// Publish it unless someone else got there first or the cache has been
+	// flushed in the meantime, in which case it's only used for this render.
+	mutex_lock(&cache->lock);
+	if ((cache->skeleton == skeleton) && (cache->generation == generation)) {
+		sync_store_ptr(&cache->skeleton, built);
+		epoch_retire(cache->reclaim, skeleton, destroy_page_skeleton);
+	} else {
+		epoch_retire(cache->reclaim, built, destroy_page_skeleton);
+	}
+	mutex_unlock(&cache->lock);
+
+	*found = built;
+	return UKI_OK;
+}
+
+/**
+ * Throws away the page skeleton. It'll be built again the next time it's
+ * needed.
+ *
+ * @param cache Template cache holding the skeleton.
+ */
+void free_page_skeleton(uki_template_cache *cache) {
+	uki_page_skeleton_t *skeleton;
+
+	mutex_lock(&cache->lock);
+	skeleton = cache->skeleton;
+	sync_store_ptr(&cache->skeleton, NULL);
+	sync_add(&cache->generation, 1);
+	epoch_retire(cache->reclaim, skeleton, destroy_page_skeleton);
+	mutex_unlock(&cache->lock);
 }
 
 /**
- * Substitutes article page found inside a template.
+ * Frees a page skeleton.
  *
- * @param  filled_template Template contents already all populated.
- * @param  path            Article page absolute path.
- * @return                 UKI_OK when the substitution was successful.
+ * @param skeleton Page skeleton to be freed. (Can be NULL)
  */
-uki_error render_article_in_template(char **filled_template, const char *path) {
-	char *article;
+void destroy_page_skeleton(void *skeleton) {
+	uki_page_skeleton_t *skel = (uki_page_skeleton_t*)skeleton;
+
+	if (skel == NULL)
+		return;
+
+	mem_free(skel->template_name);
+	mem_free(skel->page);
+	mem_free(skel->deps);
+	mem_free(skel->deps_info);
+	mem_free(skel);
+}
+
+/**
+ * Gets everything ready to render a page: makes sure the template and all of
+ * its includes (or the page skeleton) are available and opens the article.
+ *
+ * @param  state         Rendering state.
+ * @param  template_name The template file to place the article into.
+ * @param  article_path  Article page absolute path.
+ * @param  template      Compiled template to render or NULL if the page
+ *                       skeleton should be used instead.
+ * @param  article       Article file view. (Must be closed if UKI_OK)
+ * @return               UKI_OK if the page is ready to be rendered.
+ */
+uki_error prepare_page(render_state_t *state, const char *template_name,
+					   const char *article_path,
+					   const uki_compiled_template_t **template,
+					   file_view_t *article) {
+	uki_template_cache *cache = state->cache;
+	const uki_page_skeleton_t *skeleton = NULL;
+	bool has_body;
+	uki_error err;
+
+	// Get the template for placing the article into.
+	*template = NULL;
+	if (sync_load(&cache->skeleton_enabled)) {
+		if ((err = prepare_page_skeleton(cache, template_name, state->ticket,
+										 *state->variables,
+										 &skeleton)) != UKI_OK)
+			return err;
+		has_body = skeleton->nbodies > 0;
+	} else {
+		if ((err = template_cache_get(cache, template_name, state->ticket,
+									  template)) != UKI_OK)
+			return err;
+		has_body = false;
+		if ((err = resolve_includes(cache, state->ticket, *template,
+									&has_body, NULL, 0)) != UKI_OK)
+			return err;
+	}
 
-	// Check if there is an article there.
-	if (!file_exists(path))
-		return UKI_ERROR_NOARTICLE;
+	// Open the article, which is also how we find out if there is one.
+	if (!open_file_view(article, article_path)) {
+		return file_exists(article_path) ? UKI_ERROR_PARSING_ARTICLE :
+			UKI_ERROR_NOARTICLE;
+	}
 
 	// Check if there is a body variable available in the template.
-	if (strstr(*filled_template, TEMPLATE_BODY_MATCH) == NULL) {
-		return UKI_ERROR_BODYVAR_NOTFOUND;
+	err = UKI_OK;
+	if (!has_body)
+		err = UKI_ERROR_BODYVAR_NOTFOUND;
+
+	// Make sure the skeleton itself rendered fine or fall back to the template
+	// if it can't be used.
+	if ((err == UKI_OK) && (skeleton != NULL)) {
+		if (skeleton->status != UKI_OK) {
+			err = skeleton->status;
+		} else if (skeleton->nbodies > 1) {
+			err = template_cache_get(cache, template_name, state->ticket,
+									 template);
+		}
+		if (err == UKI_OK)
+			state->skeleton = skeleton;
 	}
 
-	// Slurp file.
-	slurp_file(&article, path);
-	if (article == NULL)
-		return UKI_ERROR_PARSING_ARTICLE;
+	if (err != UKI_OK)
+		close_file_view(article);
+	return err;
+}
+
+/**
+ * Renders a prepared page, placing the article either inside the template or
+ * between the pre-rendered halves of the page skeleton.
+ *
+ * @param  state    Rendering state.
+ * @param  template Compiled template or NULL to use the page skeleton.
+ * @param  article  Article file view.
+ * @return          UKI_OK if the rendering went smoothly.
+ */
+uki_error emit_page(render_state_t *state,
+					const uki_compiled_template_t *template,
+					const file_view_t *article) {
+	const uki_page_skeleton_t *skeleton = state->skeleton;
+	uki_error err;
+
+	// Render everything in a single pass.
+	if (template != NULL) {
+		state->body = article;
+		return render_nodes(state, template, 0);
+	}
 
-	// Replace the body variable
-	replace_string(filled_template, TEMPLATE_BODY_MATCH, article,
-				   SUBSTITUTE_STRING);
+	// Place the article between the pre-rendered halves of the template.
+	emit_text(state, skeleton->page, skeleton->split);
+	if ((err = emit_article(state, article->data, article->size)) != UKI_OK)
+		return err;
+	emit_text(state, skeleton->page + skeleton->split,
+			  skeleton->len - skeleton->split);
 
-	// Free the slurped article and return.
-	free(article);
 	return UKI_OK;
 }
 
 /**
- * Puts a string inside another string given a substring to find.
+ * Renders a whole page with an article inside a template.
  *
- * @param haystack String that will have its contents changed.
- * @param needle   What we want to find inside.
- * @param substr   Substitute string to be added to the base string.
- * @param type     Is this a template or variable substitution?
+ * @param  rendered      The final rendered page. Allocated by this function.
+ * @param  cache         Template cache.
+ * @param  template_name The template file to place the article into.
+ * @param  article_path  Article page absolute path.
+ * @param  variables     Variables container.
+ * @return               UKI_OK if the rendering went smoothly.
  */
-void replace_string(char **haystack, const char *needle, const char *substr,
-					const uint8_t type) {
-	char cmpneedle[UKI_MAX_TEMPLATE_NAME + 3];
+uki_error render_page_template(char **rendered, uki_template_cache *cache,
+							   const char *template_name,
+							   const char *article_path,
+							   const uki_variable_container variables) {
+	const uki_compiled_template_t *template;
+	render_state_t state;
+	file_view_t article;
+	uki_error err;
+	strbuf_t out;
+
+	// Get the template and the article.
+	*rendered = NULL;
+	init_render_state(&state, cache, &variables);
+	if ((err = prepare_page(&state, template_name, article_path, &template,
+							&article)) != UKI_OK)
+		return err;
 
-	// Build comparison needle.
-	if (type == SUBSTITUTE_TEMPLATE) {
-		sprintf(cmpneedle, "[%s]", needle);
-	} else if (type == SUBSTITUTE_VARIABLE) {
-		sprintf(cmpneedle, "%%%s%%", needle);
+	// Render everything in a single pass inside the arena and only copy the
+	// finished page into the heap.
+	arena_begin(state.arena);
+	strbuf_init_arena(&out, state.arena, article.size + ((template == NULL) ?
+					  state.skeleton->len + 1 : TEMPLATE_RENDER_SLACK));
+	state.out = &out;
+	if ((err = emit_page(&state, template, &article)) == UKI_OK)
+		*rendered = strbuf_detach(&out);
+
+	// Clean up and return.
+	strbuf_free(&out);
+	arena_end(state.arena);
+	close_file_view(&article);
+	return err;
+}
+
+/**
+ * Renders a whole page with an article inside a template into a caller
+ * supplied buffer without allocating any memory.
+ * @remark Just like snprintf the rendered page is truncated if it doesn't fit.
+ *
+ * @param  buf           Pre-allocated buffer. (Can be NULL if cap is 0)
+ * @param  cap           Size of the buffer.
+ * @param  needed        Size of the buffer needed to hold the whole page
+ *                       including the NULL terminator.
+ * @param  cache         Template cache.
+ * @param  template_name The template file to place the article into.
+ * @param  article_path  Article page absolute path.
+ * @param  variables     Variables container.
+ * @return               UKI_OK if the rendering went smoothly or
+ *                       UKI_ERROR_BUFFER_TOO_SMALL if the page didn't fit.
+ */
+uki_error render_page_into(char *buf, const size_t cap, size_t *needed,
+						   uki_template_cache *cache,
+						   const char *template_name, const char *article_path,
+						   const uki_variable_container variables) {
+	const uki_compiled_template_t *template;
+	render_state_t state;
+	file_view_t article;
+	uki_error err;
+	strbuf_t out;
+
+	// Get the template and the article.
+	*needed = 0;
+	strbuf_init_fixed(&out, buf, cap);
+	init_render_state(&state, cache, &variables);
+	if ((err = prepare_page(&state, template_name, article_path, &template,
+							&article)) != UKI_OK)
+		return err;
+
+	// Render everything into the buffer.
+	state.out = &out;
+	err = emit_page(&state, template, &article);
+	close_file_view(&article);
+	if (err != UKI_OK)
+		return err;
+
+	// Report the size we actually needed.
+	*needed = out.len + 1;
+	if (strbuf_overflowed(&out))
+		return UKI_ERROR_BUFFER_TOO_SMALL;
+
+	return UKI_OK;
+}
+
+/**
+ * Renders a whole page with an article inside a template as a list of
+ * segments pointing to the template text, variable values and the article,
+ * without ever concatenating them.
+ * @remark The segments stay valid until free_page_iov() is called, even if the
+ *         templates change or the wiki is reloaded in the meantime, since the
+ *         page holds a read section of the cache's reclamation domain.
+ *
+ * @param  rendered      The rendered page segments. Must always be freed with
+ *                       free_page_iov().
+ * @param  cache         Template cache.
+ * @param  template_name The template file to place the article into.
+ * @param  article_path  Article page absolute path.
+ * @param  variables     Variables container.
+ * @return               UKI_OK if the rendering went smoothly.
+ */
+uki_error render_page_iov(uki_page_iov_t *rendered, uki_template_cache *cache,
+						  const char *template_name, const char *article_path,
+						  const uki_variable_container variables) {
+	const uki_compiled_template_t *template;
+	render_state_t state;
+	uki_error err;
+
+	// Initialize the segment list.
+	rendered->size = 0;
+	rendered->capacity = 0;
+	rendered->len = 0;
+	rendered->list = NULL;
+	rendered->article.data = NULL;
+	rendered->reclaim = NULL;
+
+	// Get the template and the article.
+	init_render_state(&state, cache, &variables);
+	if ((err = prepare_page(&state, template_name, article_path, &template,
+							&rendered->article)) != UKI_OK) {
+		rendered->article.data = NULL;
+		return err;
+	}
+
+	// Point the segments at everything and keep it alive until we're freed.
+	state.iov = rendered;
+	rendered->reclaim = cache->reclaim;
+	rendered->pin = epoch_enter(cache->reclaim);
+	arena_begin(state.arena);
+	err = emit_page(&state, template, &rendered->article);
+
+	// Move the segment list out of the arena.
+	if ((err == UKI_OK) && (rendered->size > 0)) {
+		rendered->list = arena_detach(rendered->list, sizeof(uki_iovec_t) *
+									  rendered->size);
 	} else {
-		strncpy(cmpneedle, needle, UKI_MAX_TEMPLATE_NAME);
+		rendered->list = NULL;
 	}
+	rendered->capacity = rendered->size;
+	arena_end(state.arena);
+
+	// Release everything if something went wrong.
+	if (err != UKI_OK)
+		free_page_iov(rendered);
+
+	return err;
+}
+
+/**
+ * Frees the segments of a rendered page and releases the template text they
+ * were pointing to.
+ *
+ * @param rendered Rendered page segments.
+ */
+void free_page_iov(uki_page_iov_t *rendered) {
+	// Release the cache if we were holding on to it.
+	if (rendered->article.data != NULL)
+		close_file_view(&rendered->article);
+	if (rendered->reclaim != NULL)
+		epoch_leave(rendered->reclaim, rendered->pin);
+	rendered->article.data = NULL;
+	rendered->reclaim = NULL;
+
+	mem_free(rendered->list);
+	rendered->list = NULL;
+	rendered->size = 0;
+	rendered->capacity = 0;
+	rendered->len = 0;
+}
+
+/**
+ * Initializes a page dependencies structure.
+ *
+ * @param deps Page dependencies structure.
+ */
+void initialize_page_deps(uki_page_deps_t *deps) {
+	deps->ntemplates = 0;
+	deps->templates = NULL;
+	deps->nvariables = 0;
+	deps->variables = NULL;
+}
+
+/**
+ * Gathers every template file (including the nested includes) and variable
+ * that goes into rendering a template.
+ * @remark Must be called inside a read section of the cache's reclamation
+ *         domain.
+ *
+ * @param  deps          Page dependencies to add to.
+ * @param  cache         Template cache.
+ * @param  template_name The template to start from.
+ * @return               UKI_OK if all the templates are available.
+ */
+uki_error template_dependencies(uki_page_deps_t *deps,
+								uki_template_cache *cache,
+								const char *template_name) {
+	unsigned long ticket = 0;
+
+	// Get a ticket so that the templates are validated just like in a render.
+	if (sync_load(&cache->mode) == UKI_CACHE_VALIDATE)
+		ticket = sync_add(&cache->renders, 1);
+
+	return collect_template_deps(deps, cache, ticket, template_name, 0);
+}
+
+/**
+ * Recursively gathers the dependencies of a template.
+ *
+ * @param  deps          Page dependencies to add to.
+ * @param  cache         Template cache.
+ * @param  ticket        Ticket of the lookups.
+ * @param  template_name The template to look into.
+ * @param  depth         Current include depth.
+ * @return               UKI_OK if all the templates are available.
+ */
+uki_error collect_template_deps(uki_page_deps_t *deps,
+								uki_template_cache *cache,
+								const unsigned long ticket,
+								const char *template_name, const int depth) {
+	const uki_compiled_template_t *template;
+	const uki_template_node_t *node;
+	uki_error err;
+	size_t i;
+
+	// Guard against templates that include themselves.
+	if (depth > TEMPLATE_MAX_DEPTH)
+		return UKI_ERROR_PARSING_TEMPLATE;
+
+	// Templates included more than once only need to be looked into once.
+	if (find_dependency(deps->templates, deps->ntemplates, template_name))
+		return UKI_OK;
+	if ((err = template_cache_get(cache, template_name, ticket,
+								  &template)) != UKI_OK)
+		return err;
+	push_dependency(&deps->templates, &deps->ntemplates, template_name,
+					strlen(template_name));
+
+	for (i = 0; i < template->size; i++) {
+		node = &template->nodes[i];
+
+		switch (node->type) {
+		case TEMPLATE_NODE_INCLUDE:
+			if ((err = collect_template_deps(deps, cache, ticket, node->str,
+											 depth + 1)) != UKI_OK)
+				return err;
+			break;
+		case TEMPLATE_NODE_VARIABLE:
+			push_dependency(&deps->variables, &deps->nvariables, node->str,
+							node->len);
+			break;
+		}
+	}
+
+	return UKI_OK;
+}
+
+/**
+ * Gathers every variable used by an article.
+ *
+ * @param  deps Page dependencies to add to.
+ * @param  text Article contents. (Doesn't need to be NULL terminated)
+ * @param  len  Length of the article contents.
+ * @return      UKI_OK if the article could be parsed.
+ */
+uki_error article_dependencies(uki_page_deps_t *deps, const char *text,
+							   const size_t len) {
+	const char *end = text + len;
+	const char *cursor = text;
+	const char *tag;
+	const char *close;
+
+	// Go through the article looking for variable tags just like emit_article.
+	while ((tag = memchr(cursor, TEMPLATE_VAR_DELIM, end - cursor)) != NULL) {
+		close = memchr(tag + 1, TEMPLATE_VAR_DELIM, end - tag - 1);
+		if ((close == NULL) || (close == (tag + 1)) ||
+				((close - tag - 1) >= TEMPLATE_TAG_MAX_CHAR))
+			return UKI_ERROR_PARSING_TEMPLATE;
+
+		push_dependency(&deps->variables, &deps->nvariables, tag + 1,
+						close - tag - 1);
+		cursor = close + 1;
+	}
+
+	return UKI_OK;
+}
+
+/**
+ * Checks if a page depends on a template.
+ *
+ * @param  deps          Page dependencies.
+ * @param  template_name Template name.
+ * @return               TRUE if the template goes into rendering the page.
+ */
+bool depends_on_template(const uki_page_deps_t *deps,
+						 const char *template_name) {
+	return find_dependency(deps->templates, deps->ntemplates, template_name);
+}
+
+/**
+ * Checks if a page depends on a variable.
+ *
+ * @param  deps Page dependencies.
+ * @param  key  Variable key.
+ * @return      TRUE if the variable goes into rendering the page.
+ */
+bool depends_on_variable(const uki_page_deps_t *deps, const char *key) {
+	return find_dependency(deps->variables, deps->nvariables, key);
+}
+
+/**
+ * Adds a name to a list of dependencies if it isn't already there.
+ *
+ * @param list List of dependencies.
+ * @param size Number of dependencies in the list.
+ * @param name Name to be added. (Doesn't need to be NULL terminated)
+ * @param len  Length of the name.
+ */
+void push_dependency(char ***list, size_t *size, const char *name,
+					 const size_t len) {
+	size_t i;
+
+	for (i = 0; i < *size; i++) {
+		if ((strncmp((*list)[i], name, len) == 0) && ((*list)[i][len] == '\0'))
+			return;
+	}
+
+	*list = mem_realloc(*list, sizeof(char*) * (*size + 1));
+	(*list)[*size] = (char*)mem_malloc((len + 1) * sizeof(char));
+	memcpy((*list)[*size], name, len);
+	(*list)[(*size)++][len] = '\0';
+}
+
+/**
+ * Checks if a name is in a list of dependencies.
+ *
+ * @param  list List of dependencies.
+ * @param  size Number of dependencies in the list.
+ * @param  name Name to look for.
+ * @return      TRUE if the name is in the list.
+ */
+bool find_dependency(char **list, const size_t size, const char *name) {
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		if (strcmp(list[i], name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Frees a page dependencies structure.
+ *
+ * @param deps Page dependencies structure.
+ */
+void free_page_deps(uki_page_deps_t *deps) {
+	size_t i;
 
-	// Replace the string.
-	strsreplace(haystack, cmpneedle, substr);
+	for (i = 0; i < deps->ntemplates; i++)
+		mem_free(deps->templates[i]);
+	for (i = 0; i < deps->nvariables; i++)
+		mem_free(deps->variables[i]);
+	mem_free(deps->templates);
+	mem_free(deps->variables);
+	initialize_page_deps(deps);
 }
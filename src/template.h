@@ -10,9 +10,14 @@
 
 #include "windowshelper.h"
 #include "config.h"
+#include "fileutils.h"
+#include "strutils.h"
+#include "epoch.h"
+#include "sync.h"
 
 #ifdef UNIX
 #include <stdbool.h>
+#include <sys/uio.h>
 #endif
 
 // Template structure.
@@ -21,30 +26,178 @@ typedef struct {
 	char *name;
 	char *parent;
 	int   deepness;
+	file_info_t info;
 } uki_template_t;
 
 // Template container.
 typedef struct {
+	char root[UKI_MAX_PATH];
 	size_t size;
 	uki_template_t *list;
 } uki_template_container;
 
+// Compiled template node types.
+#define TEMPLATE_NODE_TEXT     0
+#define TEMPLATE_NODE_INCLUDE  1
+#define TEMPLATE_NODE_VARIABLE 2
+#define TEMPLATE_NODE_BODY     3
+
+// Compiled template node.
+typedef struct {
+	uint8_t type;
+	const char *str;
+	size_t len;
+	unsigned long hash;
+} uki_template_node_t;
+
+// Compiled template.
+typedef struct {
+	char *source;
+	bool has_body;
+	size_t size;
+	size_t capacity;
+	uki_template_node_t *nodes;
+	file_info_t info;
+} uki_compiled_template_t;
+
+// Template cache entry.
+typedef struct {
+	char *name;
+	unsigned long hash;
+	unsigned long checked;
+	uki_compiled_template_t *compiled;
+} uki_template_cache_entry_t;
+
+// Template cache hash table slot.
+typedef struct {
+	unsigned long hash;
+	size_t index;
+} uki_template_slot_t;
+
+// Template cache lookup table. (Immutable once published)
+typedef struct {
+	size_t size;
+	uki_template_cache_entry_t **list;
+	size_t nslots;
+	uki_template_slot_t *slots;
+} uki_template_table_t;
+
+// Scatter/gather segment. (Same layout as struct iovec)
+#ifdef UNIX
+typedef struct iovec uki_iovec_t;
+#else
+typedef struct {
+	void  *iov_base;
+	size_t iov_len;
+} uki_iovec_t;
+#endif
+
+// Page rendered as a list of segments.
+typedef struct {
+	size_t size;
+	size_t capacity;
+	size_t len;
+	uki_iovec_t *list;
+	file_view_t article;
+	epoch_domain_t *reclaim;
+	unsigned long pin;
+} uki_page_iov_t;
+
+// Pre-rendered page skeleton. (Immutable once published)
+typedef struct {
+	uki_error status;
+	char *template_name;
+	char *page;
+	size_t len;
+	size_t split;
+	size_t nbodies;
+	size_t ndeps;
+	uki_template_cache_entry_t **deps;
+	file_info_t *deps_info;
+} uki_page_skeleton_t;
+
+// Templates and variables a page depends on.
+typedef struct {
+	size_t ntemplates;
+	char **templates;
+	size_t nvariables;
+	char **variables;
+} uki_page_deps_t;
+
+// Template cache.
+typedef struct {
+	char root[UKI_MAX_PATH];
+	unsigned long mode;
+	unsigned long skeleton_enabled;
+	unsigned long renders;
+	unsigned long generation;
+	epoch_domain_t *reclaim;
+	mutex_t lock;
+	uki_template_table_t *table;
+	uki_page_skeleton_t *skeleton;
+} uki_template_cache;
+
 // Memory management.
 void initialize_templating(uki_template_container *container,
-						   const char *_wiki_root);
+						   const char *wiki_root);
 uki_template_t add_template(uki_template_container *container,
-							const char *fpath);
-uki_error populate_templates(uki_template_container *container);
+							const char *fpath, const file_info_t *info);
+uki_error populate_templates(uki_template_container *container,
+							 const size_t nthreads);
+void clone_templates(uki_template_container *clone,
+					 const uki_template_container *container);
+void release_templates(uki_template_container container);
 void free_templates(uki_template_container container);
 
 // Lookup.
 uki_template_t find_template_i(const size_t index,
 							   const uki_template_container container);
 
+// Compilation.
+uki_error compile_text(uki_compiled_template_t *compiled, char *text);
+void free_compiled_template(uki_compiled_template_t *compiled);
+
+// Caching.
+void initialize_template_cache(uki_template_cache *cache,
+							   const char *wiki_root, const uint8_t mode,
+							   epoch_domain_t *reclaim);
+uki_error template_cache_get(uki_template_cache *cache,
+							 const char *template_name,
+							 const unsigned long ticket,
+							 const uki_compiled_template_t **compiled);
+size_t refresh_template_cache(uki_template_cache *cache);
+void flush_template_cache(uki_template_cache *cache);
+void free_template_cache(uki_template_cache *cache);
+void free_page_skeleton(uki_template_cache *cache);
+
 // Rendering.
-uki_error render_template(char **rendered, const char *template_name);
-uki_error render_article_in_template(char **filled_template, const char *path);
-uki_error render_variables(char **filled_template,
+uki_error render_compiled_template(strbuf_t *out, uki_template_cache *cache,
+								   const uki_compiled_template_t *template,
+								   const file_view_t *body,
+								   const uki_variable_container variables);
+uki_error render_page_template(char **rendered, uki_template_cache *cache,
+							   const char *template_name,
+							   const char *article_path,
+							   const uki_variable_container variables);
+uki_error render_page_into(char *buf, const size_t cap, size_t *needed,
+						   uki_template_cache *cache,
+						   const char *template_name, const char *article_path,
 						   const uki_variable_container variables);
+uki_error render_page_iov(uki_page_iov_t *rendered, uki_template_cache *cache,
+						  const char *template_name, const char *article_path,
+						  const uki_variable_container variables);
+void free_page_iov(uki_page_iov_t *rendered);
+
+// Dependencies.
+void initialize_page_deps(uki_page_deps_t *deps);
+uki_error template_dependencies(uki_page_deps_t *deps,
+								uki_template_cache *cache,
+								const char *template_name);
+uki_error article_dependencies(uki_page_deps_t *deps, const char *text,
+							   const size_t len);
+bool depends_on_template(const uki_page_deps_t *deps,
+						 const char *template_name);
+bool depends_on_variable(const uki_page_deps_t *deps, const char *key);
+void free_page_deps(uki_page_deps_t *deps);
 
 #endif /* _TEMPLATE_H_ */
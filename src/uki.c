@@ -8,6 +8,14 @@
 #define UKI_DLL_EXPORTS
 #include "uki.h"
 #include "fileutils.h"
+#include "arena.h"
+#include "allocator.h"
+#include "epoch.h"
+#include "sync.h"
+#include "pool.h"
+#include "pagecache.h"
+#include "compress.h"
+#include "shmcache.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -15,15 +23,125 @@
 #include <stdbool.h>
 #endif
 
+// Everything needed to render a page. (Immutable once published)
+typedef struct {
+	uki_variable_container configs;
+	uki_variable_container variables;
+	uki_template_cache template_cache;
+	unsigned long fingerprint;
+} wiki_settings_t;
+
+// Wiki context structure.
+struct uki_ctx_s {
+	char *wiki_root;
+	bool initialized;
+	uint8_t cache_mode;
+	bool skeleton_enabled;
+	mutex_t lock;
+	epoch_domain_t reclaim;
+	mutex_t batch_lock;
+	size_t nworkers;
+	pool_t *pool;
+	page_cache_t page_cache;
+	shm_cache_t *shared;
+	bool refreshing;
+	thread_t refresher;
+	semaphore_t refresh_wake;
+	unsigned long refresh_interval;
+	wiki_settings_t *settings;
+	uki_article_container *articles;
+	uki_template_container *templates;
+};
+
+// Batch rendering job.
+typedef struct {
+	uki_ctx_t *ctx;
+	const size_t *indices;
+	const char **pages;
+	uki_render_callback_t callback;
+	void *user;
+	uki_error err;
+} batch_job_t;
+
+// Static export job.
+typedef struct {
+	uki_ctx_t *ctx;
+	const char *out_root;
+	uki_article_container *articles;
+	size_t *indices;
+	dirlist_t assets;
+	bool full;
+	long rendered;
+	long copied;
+	long failed;
+	uki_error err;
+} export_job_t;
+
 // Private variables.
-char *wiki_root;
-bool uki_initialized = false;
-uki_variable_container configs;
-uki_variable_container variables;
-uki_article_container articles;
-uki_template_container templates;
+static uki_ctx_t default_ctx;
 
 // Private methods.
+uki_error initialize_context(uki_ctx_t *ctx, const char *wiki_path);
+void clean_context(uki_ctx_t *ctx);
+uki_error load_wiki(uki_ctx_t *ctx, wiki_settings_t **settings,
+					uki_article_container **articles,
+					uki_template_container **templates);
+unsigned long settings_fingerprint(const char *wiki_root,
+								   const wiki_settings_t *settings);
+size_t scan_threads(const wiki_settings_t *settings);
+void destroy_settings(void *settings);
+void destroy_shared_cache(void *shared);
+void destroy_articles(void *articles);
+void destroy_article_list(void *articles);
+void destroy_article_deps(void *deps);
+void destroy_templates(void *templates);
+void destroy_template_list(void *templates);
+bool article_exists(uki_ctx_t *ctx, const char *article_path);
+uki_error render_page_file(uki_ctx_t *ctx, char **rendered,
+						   const char *article_path);
+uki_error render_article_page(uki_ctx_t *ctx, char **rendered,
+							  const size_t index);
+uki_error fetch_cached_page(uki_ctx_t *ctx, page_cache_entry_t **entry,
+							const char *page, wiki_settings_t *settings);
+uki_error render_cached_page(uki_ctx_t *ctx, page_cache_entry_t **entry,
+							 const char *page);
+uki_error render_page_entry(uki_ctx_t *ctx, page_cache_entry_t *entry,
+							const char *article_path,
+							const unsigned long compress);
+void keep_cached_page(uki_ctx_t *ctx, page_cache_entry_t *entry);
+void run_in_pool(uki_ctx_t *ctx, pool_task_t task, void *job, const size_t n);
+void start_refresher(uki_ctx_t *ctx);
+void stop_refresher(uki_ctx_t *ctx);
+void refresh_caches(uki_ctx_t *ctx);
+#ifdef WINDOWS
+DWORD WINAPI refresh_worker(LPVOID arg);
+#else
+void* refresh_worker(void *arg);
+#endif
+void render_batch_item(void *job, const size_t item);
+uki_error main_template_dependencies(uki_ctx_t *ctx, uki_page_deps_t *deps);
+uki_error article_file_dependencies(uki_page_deps_t *deps,
+									const char *article_path);
+uki_error collect_dependents(uki_ctx_t *ctx, size_t **indices, size_t *n,
+							 const char *name, const bool template);
+const uki_article_deps_t* recorded_article_deps(uki_ctx_t *ctx,
+												const uki_article_t article,
+												const file_info_t *info);
+void export_state_fpath(uki_ctx_t *ctx, char *fpath, const char *out_root);
+void newest_dependency(uki_ctx_t *ctx, const uki_page_deps_t *common,
+					   const bool has_state, file_info_t *newest);
+bool export_page_stale(uki_ctx_t *ctx, const uki_article_t article,
+					   const char *out_root, const file_info_t newest,
+					   const bool has_state,
+					   const uki_variable_container exported,
+					   const uki_variable_container current);
+bool variables_changed(const uki_page_deps_t *deps,
+					   const uki_variable_container previous,
+					   const uki_variable_container current);
+bool write_variables(const char *fname,
+					 const uki_variable_container variables);
+void export_article_item(void *job, const size_t item);
+void export_asset_item(void *job, const size_t item);
 uki_error populate_variable_container(const char *wiki_root,
 									  const char *var_fname,
 									  uki_variable_container *container);
@@ -37,12 +155,16 @@ uki_error populate_variable_container(const char *wiki_root,
  * @param  lpReserved         Reserved for the future.
  * @return                    TRUE if the DLL should load.
  */
-BOOL APIENTRY DllMain(HANDLE hModule, DWORD ul_reason_for_call, LPVOID lpReserved) {
+BOOL APIENTRY DllMain(HANDLE hModule, DWORD ul_reason_for_call,
+					  LPVOID lpReserved) {
     switch (ul_reason_for_call) {
 		case DLL_PROCESS_ATTACH:
 		case DLL_THREAD_ATTACH:
+			break;
 		case DLL_THREAD_DETACH:
 		case DLL_PROCESS_DETACH:
+			// Give back the memory held for rendering in this thread.
+			render_arena_release();
 			break;
     }
 
@@ -51,40 +173,260 @@ BOOL APIENTRY DllMain(HANDLE hModule, DWORD ul_reason_for_call, LPVOID lpReserve
 #endif
 
 /**
- * Initializes the wiki.
+ * Sets the memory allocator used for everything the library allocates,
+ * including the rendered contents handed over to the caller.
+ * @remark Must be called before uki_initialize() and not changed until after
+ *         uki_clean(), since memory must be freed by the allocator that
+ *         allocated it.
+ *
+ * @param allocator Allocation functions and their context or NULL to go back
+ *                  to the standard library ones.
+ */
+void uki_set_allocator(const uki_allocator_t *allocator) {
+	set_allocator(allocator);
+}
+
+/**
+ * Frees memory allocated by the library, such as rendered pages.
+ *
+ * @param ptr Memory to be freed.
+ */
+void uki_free(void *ptr) {
+	mem_free(ptr);
+}
+
+/**
+ * Opens a wiki in a context of its own. Contexts don't share any state, so
+ * many wikis can be served from the same process. A context can be used by
+ * many threads at the same time, even while another one reloads it.
+ *
+ * @param  ctx       Opened wiki context. (Must be closed with uki_close())
+ *                   Set to NULL if the wiki couldn't be opened.
+ * @param  wiki_path Path to the root of the uki wiki.
+ * @return           UKI_OK if the wiki was opened successfully.
+ */
+uki_error uki_open(uki_ctx_t **ctx, const char *wiki_path) {
+	uki_error err;
+
+	// Allocate a clean context and get the wiki loaded into it.
+	*ctx = (uki_ctx_t*)mem_calloc(1, sizeof(uki_ctx_t));
+	if ((err = initialize_context(*ctx, wiki_path)) != UKI_OK) {
+		uki_close(*ctx);
+		*ctx = NULL;
+	}
+
+	return err;
+}
+
+/**
+ * Closes a wiki context and frees everything it holds.
+ *
+ * @param ctx Wiki context.
+ */
+void uki_close(uki_ctx_t *ctx) {
+	if (ctx == NULL)
+		return;
+
+	clean_context(ctx);
+	mem_free(ctx);
+}
+
+/**
+ * Initializes the wiki in the default context.
  *
  * @param  wiki_path Path to the root of the uki wiki.
  * @return           UKI_OK if the initialization was completed successfully.
  */
 uki_error uki_initialize(const char *wiki_path) {
-	uki_error err;
-	uki_initialized = true;
+	return initialize_context(&default_ctx, wiki_path);
+}
+
+/**
+ * Loads a wiki into a context.
+ *
+ * @param  ctx       Wiki context to be populated.
+ * @param  wiki_path Path to the root of the uki wiki.
+ * @return           UKI_OK if the initialization was completed successfully.
+ */
+uki_error initialize_context(uki_ctx_t *ctx, const char *wiki_path) {
+	ctx->initialized = true;
+	ctx->cache_mode = UKI_CACHE_VALIDATE;
+	ctx->skeleton_enabled = false;
+	ctx->nworkers = 0;
+	ctx->pool = NULL;
+	ctx->shared = NULL;
+	ctx->refreshing = false;
+	ctx->refresh_interval = UKI_REFRESH_INTERVAL;
+	semaphore_init(&ctx->refresh_wake);
+	mutex_init(&ctx->lock);
+	mutex_init(&ctx->batch_lock);
+	epoch_init(&ctx->reclaim);
+	page_cache_init(&ctx->page_cache, &ctx->reclaim);
 
 	// Copy the wiki root path string.
-	wiki_root = (char*)malloc((strlen(wiki_path) + 1) * sizeof(char));
-	strcpy(wiki_root, wiki_path);
+	ctx->wiki_root = (char*)mem_malloc((strlen(wiki_path) + 1) * sizeof(char));
+	strcpy(ctx->wiki_root, wiki_path);
+
+	return load_wiki(ctx, &ctx->settings, &ctx->articles, &ctx->templates);
+}
+
+/**
+ * Reads the whole wiki from disk into a new set of containers.
+ *
+ * @param  ctx       Wiki context.
+ * @param  settings  Configurations, variables and an empty template cache.
+ * @param  articles  Articles container.
+ * @param  templates Templates container.
+ * @return           UKI_OK if the wiki was loaded. Nothing is allocated
+ *                   otherwise.
+ */
+uki_error load_wiki(uki_ctx_t *ctx, wiki_settings_t **settings,
+					uki_article_container **articles,
+					uki_template_container **templates) {
+	size_t nthreads;
+	uki_error err;
+
+	*settings = NULL;
+	*articles = NULL;
+	*templates = NULL;
 
 	// Populate the variable containers.
-	if ((err = populate_variable_container(wiki_root, UKI_MANIFEST_PATH,
-										   &configs)) != UKI_OK)
-		return err;
-	if ((err = populate_variable_container(wiki_root, UKI_VARIABLE_PATH,
-										   &variables)) != UKI_OK)
+	*settings = (wiki_settings_t*)mem_calloc(1, sizeof(wiki_settings_t));
+	initialize_template_cache(&(*settings)->template_cache, ctx->wiki_root,
+							  ctx->cache_mode, &ctx->reclaim);
+	(*settings)->template_cache.skeleton_enabled = ctx->skeleton_enabled;
+	if (((err = populate_variable_container(ctx->wiki_root, UKI_MANIFEST_PATH,
+					&(*settings)->configs)) != UKI_OK) ||
+			((err = populate_variable_container(ctx->wiki_root,
+					UKI_VARIABLE_PATH, &(*settings)->variables)) != UKI_OK)) {
+		destroy_settings(*settings);
+		*settings = NULL;
+
 		return err;
+	}
+	(*settings)->fingerprint = settings_fingerprint(ctx->wiki_root, *settings);
+	nthreads = scan_threads(*settings);
 
 	// Initialize templating engine and populate the templates container.
-	initialize_templating(&templates, wiki_root);
-	if ((err = populate_templates(&templates)) != UKI_OK)
+	*templates = (uki_template_container*)mem_malloc(
+		sizeof(uki_template_container));
+	initialize_templating(*templates, ctx->wiki_root);
+	if ((err = populate_templates(*templates, nthreads)) != UKI_OK) {
+		destroy_settings(*settings);
+		destroy_templates(*templates);
+		*settings = NULL;
+		*templates = NULL;
+
 		return err;
+	}
 
 	// Initialize and populate the articles container.
-	initialize_articles(&articles, wiki_root);
-	if ((err = populate_articles(&articles)) != UKI_OK)
+	*articles = (uki_article_container*)mem_malloc(
+		sizeof(uki_article_container));
+	initialize_articles(*articles, ctx->wiki_root);
+	if ((err = populate_articles(*articles, nthreads)) != UKI_OK) {
+		destroy_settings(*settings);
+		destroy_templates(*templates);
+		destroy_articles(*articles);
+		*settings = NULL;
+		*templates = NULL;
+		*articles = NULL;
+
+		return err;
+	}
+
+	return UKI_OK;
+}
+
+/**
+ * Reads the whole wiki from disk again and swaps it in for the one that is
+ * currently loaded. Renders that are in flight are never stalled: they just
+ * finish with the wiki they started with, which is only freed once they are
+ * all done.
+ * @remark If the wiki can't be loaded the current one is kept.
+ *
+ * @param  ctx Wiki context.
+ * @return     UKI_OK if the wiki was reloaded successfully.
+ */
+uki_error uki_ctx_reload(uki_ctx_t *ctx) {
+	wiki_settings_t *settings;
+	wiki_settings_t *old_settings;
+	uki_article_container *articles;
+	uki_article_container *old_articles;
+	uki_template_container *templates;
+	uki_template_container *old_templates;
+	uki_error err;
+
+	// Load everything without disturbing anyone.
+	if ((err = load_wiki(ctx, &settings, &articles, &templates)) != UKI_OK)
 		return err;
 
+	// Publish the new wiki and retire the old one.
+	mutex_lock(&ctx->lock);
+	old_settings = ctx->settings;
+	old_articles = ctx->articles;
+	old_templates = ctx->templates;
+	sync_store_ptr(&ctx->settings, settings);
+	sync_store_ptr(&ctx->articles, articles);
+	sync_store_ptr(&ctx->templates, templates);
+	epoch_retire(&ctx->reclaim, old_settings, destroy_settings);
+	epoch_retire(&ctx->reclaim, old_articles, destroy_articles);
+	epoch_retire(&ctx->reclaim, old_templates, destroy_templates);
+	mutex_unlock(&ctx->lock);
+
+	// Pages rendered with the old settings are no good anymore.
+	page_cache_flush(&ctx->page_cache);
+
 	return UKI_OK;
 }
 
+/**
+ * Default context version of uki_ctx_reload().
+ */
+uki_error uki_reload() {
+	return uki_ctx_reload(&default_ctx);
+}
+
+/**
+ * Enters a read section of the wiki. Everything handed out by the lookup
+ * functions, like article names and variable values, stays valid until the
+ * section is left, even if the wiki is reloaded in the meantime. Outside of a
+ * section it's only valid until the next reload or added article/template.
+ * @remark Sections never block anyone, but a replaced wiki is only freed once
+ *         every section that could still see it has been left, so keep them
+ *         short.
+ *
+ * @param  ctx Wiki context.
+ * @return     Token to be handed over to uki_ctx_read_end().
+ */
+unsigned long uki_ctx_read_begin(uki_ctx_t *ctx) {
+	return epoch_enter(&ctx->reclaim);
+}
+
+/**
+ * Default context version of uki_ctx_read_begin().
+ */
+unsigned long uki_read_begin() {
+	return uki_ctx_read_begin(&default_ctx);
+}
+
+/**
+ * Leaves a read section of the wiki.
+ *
+ * @param ctx   Wiki context.
+ * @param token Token returned by uki_ctx_read_begin().
+ */
+void uki_ctx_read_end(uki_ctx_t *ctx, const unsigned long token) {
+	epoch_leave(&ctx->reclaim, token);
+}
+
+/**
+ * Default context version of uki_ctx_read_end().
+ */
+void uki_read_end(const unsigned long token) {
+	uki_ctx_read_end(&default_ctx, token);
+}
+
 /**
  * Renders an article from its text contents.
  *
@@ -108,219 +450,1852 @@ uki_error uki_render_template_from_text(char **content, const int deepness) {
 }
 
 /**
- * Renders an article by its index.
+ * Renders an article by its index.
+ *
+ * @param  ctx      Wiki context.
+ * @param  rendered Rendered page contents (Free with uki_free()).
+ * @param  index    Article index.
+ * @param  preview  Is this for preview? (Will change the contents of the page)
+ * @return          UKI_OK if the operation was successful.
+ */
+uki_error uki_ctx_render_article(uki_ctx_t *ctx, char **rendered,
+								 const size_t index, const bool preview) {
+	uki_article_t article;
+	char fpath[UKI_MAX_PATH];
+	unsigned long token;
+	file_view_t view;
+	arena_t *arena;
+	uki_error err;
+	strbuf_t out;
+
+	// Get the article and its file path.
+	token = epoch_enter(&ctx->reclaim);
+	article = uki_ctx_article(ctx, index);
+	err = (article.name == NULL) ? UKI_ERROR_INDEX_NOT_FOUND :
+		uki_ctx_article_fpath(ctx, fpath, article);
+	epoch_leave(&ctx->reclaim, token);
+	if (err != UKI_OK)
+		return err;
+
+	// Just slurp the file if we don't need to change it.
+	if (!preview) {
+		slurp_file(rendered, fpath);
+		if (*rendered == NULL) {
+			return file_exists(fpath) ? UKI_ERROR_PARSING_ARTICLE :
+				UKI_ERROR_NOARTICLE;
+		}
+
+		return UKI_OK;
+	}
+
+	// Open the file.
+	if (!open_file_view(&view, fpath)) {
+		return file_exists(fpath) ? UKI_ERROR_PARSING_ARTICLE :
+			UKI_ERROR_NOARTICLE;
+	}
+
+	// Substitute asset paths straight from the file.
+	arena = render_arena();
+	arena_begin(arena);
+	strbuf_init_arena(&out, arena, view.size + 1);
+	render_assets(&out, view.data, view.size, article.deepness);
+	*rendered = strbuf_detach(&out);
+	arena_end(arena);
+	close_file_view(&view);
+
+	return UKI_OK;
+}
+
+/**
+ * Default context version of uki_ctx_render_article().
+ */
+uki_error uki_render_article(char **rendered, const size_t index,
+							 const bool preview) {
+	return uki_ctx_render_article(&default_ctx, rendered, index, preview);
+}
+
+/**
+ * Renders an article by its index into a caller supplied buffer without
+ * allocating any memory.
+ * @remark Just like snprintf the article is truncated if it doesn't fit.
+ *
+ * @param  ctx     Wiki context.
+ * @param  buf     Pre-allocated buffer. (Can be NULL if cap is 0)
+ * @param  cap     Size of the buffer.
+ * @param  needed  Size of the buffer needed to hold the whole article
+ *                 including the NULL terminator.
+ * @param  index   Article index.
+ * @param  preview Is this for preview? (Will change the contents of the page)
+ * @return         UKI_OK if the operation was successful or
+ *                 UKI_ERROR_BUFFER_TOO_SMALL if the article didn't fit.
+ */
+uki_error uki_ctx_render_article_into(uki_ctx_t *ctx, char *buf,
+									  const size_t cap, size_t *needed,
+									  const size_t index, const bool preview) {
+	uki_article_t article;
+	char fpath[UKI_MAX_PATH];
+	unsigned long token;
+	file_view_t view;
+	uki_error err;
+	strbuf_t out;
+
+	// Get the article and its file path.
+	*needed = 0;
+	token = epoch_enter(&ctx->reclaim);
+	article = uki_ctx_article(ctx, index);
+	err = (article.name == NULL) ? UKI_ERROR_INDEX_NOT_FOUND :
+		uki_ctx_article_fpath(ctx, fpath, article);
+	epoch_leave(&ctx->reclaim, token);
+	if (err != UKI_OK)
+		return err;
+
+	// Open the file.
+	if (!open_file_view(&view, fpath)) {
+		return file_exists(fpath) ? UKI_ERROR_PARSING_ARTICLE :
+			UKI_ERROR_NOARTICLE;
+	}
+
+	// Substitute asset paths if we are in preview mode.
+	strbuf_init_fixed(&out, buf, cap);
+	if (preview) {
+		render_assets(&out, view.data, view.size, article.deepness);
+	} else {
+		strbuf_append(&out, view.data, view.size);
+	}
+	close_file_view(&view);
+
+	// Report the size we actually needed.
+	*needed = out.len + 1;
+	if (strbuf_overflowed(&out))
+		return UKI_ERROR_BUFFER_TOO_SMALL;
+
+	return UKI_OK;
+}
+
+/**
+ * Default context version of uki_ctx_render_article_into().
+ */
+uki_error uki_render_article_into(char *buf, const size_t cap, size_t *needed,
+								  const size_t index, const bool preview) {
+	return uki_ctx_render_article_into(&default_ctx, buf, cap, needed, index,
+									   preview);
+}
+
+/**
+ * Render a wiki page.
+ *
+ * @param  ctx      Wiki context.
+ * @param  rendered Rendered page text (Free with uki_free()).
+ * @param  page     Relative path to the page (without the extension).
+ * @return          UKI_OK if there were no errors.
+ */
+uki_error uki_ctx_render_page(uki_ctx_t *ctx, char **rendered,
+							  const char *page) {
+	char article_path[UKI_MAX_PATH];
+
+	// Build article path and render it.
+	pathcat(3, article_path, ctx->wiki_root, UKI_ARTICLE_ROOT, page);
+	extcat(article_path, UKI_ARTICLE_EXT);
+	if (!article_exists(ctx, article_path))
+		return UKI_ERROR_NOARTICLE;
+
+	return render_page_file(ctx, rendered, article_path);
+}
+
+/**
+ * Default context version of uki_ctx_render_page().
+ */
+uki_error uki_render_page(char **rendered, const char *page) {
+	return uki_ctx_render_page(&default_ctx, rendered, page);
+}
+
+/**
+ * Checks if there's an article behind a page before doing any work to render
+ * it, so that requests for pages that don't exist are turned away quickly.
+ * The articles index is all that's needed to know when the templates cache is
+ * frozen. Otherwise articles that aren't in it are looked for on disk, since
+ * they might have been created after it was loaded and nothing rescans the
+ * articles folder in the meantime.
+ *
+ * @param  ctx          Wiki context.
+ * @param  article_path Article page absolute path.
+ * @return              TRUE if the article exists.
+ */
+bool article_exists(uki_ctx_t *ctx, const char *article_path) {
+	uki_article_container *articles;
+	wiki_settings_t *settings;
+	unsigned long token;
+	unsigned long mode;
+	size_t len;
+	bool found;
+
+	token = epoch_enter(&ctx->reclaim);
+	articles = sync_load_ptr(&ctx->articles);
+	settings = sync_load_ptr(&ctx->settings);
+	len = strlen(articles->root);
+	found = (strncmp(article_path, articles->root, len) == 0) &&
+		(find_article(article_path + len, *articles) >= 0);
+	mode = sync_load(&settings->template_cache.mode);
+	epoch_leave(&ctx->reclaim, token);
+
+	if (!found && (mode != UKI_CACHE_FROZEN))
+		found = file_exists(article_path);
+
+	return found;
+}
+
+/**
+ * Renders an article file inside the main template.
+ *
+ * @param  ctx          Wiki context.
+ * @param  rendered     Rendered page text (Free with uki_free()).
+ * @param  article_path Article page absolute path.
+ * @return              UKI_OK if there were no errors.
+ */
+uki_error render_page_file(uki_ctx_t *ctx, char **rendered,
+						   const char *article_path) {
+	wiki_settings_t *settings;
+	unsigned long token;
+	uki_error err;
+	ssize_t idx;
+
+	// Get main template and render the article inside it.
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	if ((idx = find_variable(UKI_VAR_MAIN_TEMPLATE, settings->configs)) < 0) {
+		err = UKI_ERROR_NOMAINTEMPLATE;
+	} else {
+		err = render_page_template(rendered, &settings->template_cache,
+								   settings->configs.list[idx].value,
+								   article_path, settings->variables);
+	}
+	epoch_leave(&ctx->reclaim, token);
+
+	return err;
+}
+
+/**
+ * Renders an article by its index inside the main template.
+ *
+ * @param  ctx      Wiki context.
+ * @param  rendered Rendered page text (Free with uki_free()).
+ * @param  index    Article index.
+ * @return          UKI_OK if there were no errors.
+ */
+uki_error render_article_page(uki_ctx_t *ctx, char **rendered,
+							  const size_t index) {
+	char fpath[UKI_MAX_PATH];
+	uki_article_t article;
+	unsigned long token;
+	uki_error err;
+
+	// Get the article file path.
+	token = epoch_enter(&ctx->reclaim);
+	article = uki_ctx_article(ctx, index);
+	err = (article.name == NULL) ? UKI_ERROR_INDEX_NOT_FOUND :
+		uki_ctx_article_fpath(ctx, fpath, article);
+	epoch_leave(&ctx->reclaim, token);
+	if (err != UKI_OK)
+		return err;
+
+	return render_page_file(ctx, rendered, fpath);
+}
+
+/**
+ * Renders a wiki page through the rendered pages cache. Pages in the cache are
+ * handed out as is, without copying them, for as long as none of the files
+ * they were rendered from have changed. If page compression is enabled the
+ * gzipped version of the page comes along with it. Threads that ask for a page
+ * that isn't cached while it's being rendered wait for that render instead of
+ * rendering it all over again. With the cache disabled the page is simply
+ * rendered for the caller.
+ * @remark The page is shared and read-only. Hold on to it for as little as
+ *         possible, since no memory retired by the context can be reclaimed
+ *         until it's released.
+ *
+ * @param  ctx      Wiki context.
+ * @param  rendered Rendered page. (Release with uki_ctx_release_page())
+ * @param  page     Relative path to the page (without the extension).
+ * @return          UKI_OK if there were no errors.
+ */
+uki_error uki_ctx_render_page_cached(uki_ctx_t *ctx, uki_page_ref_t *rendered,
+									 const char *page) {
+	char article_path[UKI_MAX_PATH];
+	page_cache_flight_t *flight;
+	page_cache_entry_t *entry;
+	wiki_settings_t *settings;
+	uki_error err;
+	bool cached;
+	bool leader;
+
+	// Keep whatever we find alive until the page is released.
+	rendered->data = NULL;
+	rendered->len = 0;
+	rendered->gzip = NULL;
+	rendered->gzip_len = 0;
+	rendered->reclaim = &ctx->reclaim;
+	rendered->pin = epoch_enter(&ctx->reclaim);
+	cached = (sync_load_ptr(&ctx->shared) != NULL) ||
+		page_cache_enabled(&ctx->page_cache);
+
+	// Check if we already have it and it's still good.
+	settings = sync_load_ptr(&ctx->settings);
+	if (cached && ((entry = page_cache_find(&ctx->page_cache,
+											page)) != NULL)) {
+		if ((sync_load(&settings->template_cache.mode) != UKI_CACHE_VALIDATE) ||
+				page_cache_entry_valid(entry)) {
+			rendered->data = entry->data;
+			rendered->len = entry->len;
+			rendered->gzip = entry->gzip;
+			rendered->gzip_len = entry->gzip_len;
+
+			return UKI_OK;
+		}
+
+		page_cache_remove(&ctx->page_cache, entry);
+	}
+
+	// Don't bother with pages that don't exist.
+	pathcat(3, article_path, ctx->wiki_root, UKI_ARTICLE_ROOT, page);
+	extcat(article_path, UKI_ARTICLE_EXT);
+	if (!article_exists(ctx, article_path)) {
+		uki_ctx_release_page(ctx, rendered);
+		return UKI_ERROR_NOARTICLE;
+	}
+
+	// Without a cache to keep it in just render it for this one caller.
+	if (!cached) {
+		entry = page_cache_entry(&ctx->page_cache, page);
+		err = render_page_entry(ctx, entry, article_path,
+								sync_load(&ctx->page_cache.compress));
+		if (err != UKI_OK) {
+			destroy_page_cache_entry(entry);
+			uki_ctx_release_page(ctx, rendered);
+			return err;
+		}
+
+		// It's freed as soon as it's released.
+		epoch_retire(&ctx->reclaim, entry, destroy_page_cache_entry);
+		rendered->data = entry->data;
+		rendered->len = entry->len;
+		rendered->gzip = entry->gzip;
+		rendered->gzip_len = entry->gzip_len;
+
+		return UKI_OK;
+	}
+
+	// Only one of us has to render it, everyone else can wait for it.
+	flight = page_cache_takeoff(&ctx->page_cache, page, &leader);
+	if (leader) {
+		// Land before the page can be evicted, so every waiter is pinned.
+		err = fetch_cached_page(ctx, &entry, page, settings);
+		page_cache_land(&ctx->page_cache, flight, entry, err);
+		if (err == UKI_OK)
+			keep_cached_page(ctx, entry);
+	} else {
+		entry = page_cache_wait(&ctx->page_cache, flight, &err);
+	}
+	if (err != UKI_OK) {
+		uki_ctx_release_page(ctx, rendered);
+		return err;
+	}
+	rendered->data = entry->data;
+	rendered->len = entry->len;
+	rendered->gzip = entry->gzip;
+	rendered->gzip_len = entry->gzip_len;
+
+	return UKI_OK;
+}
+
+/**
+ * Default context version of uki_ctx_render_page_cached().
+ */
+uki_error uki_render_page_cached(uki_page_ref_t *rendered, const char *page) {
+	return uki_ctx_render_page_cached(&default_ctx, rendered, page);
+}
+
+/**
+ * Releases a page rendered with uki_ctx_render_page_cached().
+ *
+ * @param ctx      Wiki context.
+ * @param rendered Rendered page.
+ */
+void uki_ctx_release_page(uki_ctx_t *ctx, uki_page_ref_t *rendered) {
+	(void)ctx;
+
+	if (rendered->reclaim != NULL)
+		epoch_leave(rendered->reclaim, rendered->pin);
+	rendered->reclaim = NULL;
+	rendered->data = NULL;
+	rendered->len = 0;
+	rendered->gzip = NULL;
+	rendered->gzip_len = 0;
+}
+
+/**
+ * Default context version of uki_ctx_release_page().
+ */
+void uki_release_page(uki_page_ref_t *rendered) {
+	uki_ctx_release_page(&default_ctx, rendered);
+}
+
+/**
+ * Sets how much memory the rendered pages cache may use. The least recently
+ * used pages are evicted to stay within it.
+ *
+ * @param ctx    Wiki context.
+ * @param budget Memory budget in bytes. (0 disables the cache, the default)
+ */
+void uki_ctx_page_cache_budget(uki_ctx_t *ctx, const size_t budget) {
+	page_cache_budget(&ctx->page_cache, budget);
+}
+
+/**
+ * Default context version of uki_ctx_page_cache_budget().
+ */
+void uki_page_cache_budget(const size_t budget) {
+	uki_ctx_page_cache_budget(&default_ctx, budget);
+}
+
+/**
+ * Throws away every page in the rendered pages cache, including the ones in the
+ * shared cache, if there's one.
+ *
+ * @param ctx Wiki context.
+ */
+void uki_ctx_flush_page_cache(uki_ctx_t *ctx) {
+	shm_cache_t *shared;
+	unsigned long pin;
+
+	page_cache_flush(&ctx->page_cache);
+
+	pin = epoch_enter(&ctx->reclaim);
+	if ((shared = sync_load_ptr(&ctx->shared)) != NULL)
+		shm_cache_flush(shared);
+	epoch_leave(&ctx->reclaim, pin);
+}
+
+/**
+ * Default context version of uki_ctx_flush_page_cache().
+ */
+void uki_flush_page_cache() {
+	uki_ctx_flush_page_cache(&default_ctx);
+}
+
+/**
+ * Sets whether a gzipped copy of every page should be made along with it when
+ * it's rendered into the cache or exported, so that it can be served with a
+ * "Content-Encoding: gzip" header without compressing it on every request.
+ *
+ * @param  ctx     Wiki context.
+ * @param  enabled Should the pages be compressed?
+ * @return         UKI_OK or UKI_ERROR_NO_COMPRESSION if the library was built
+ *                 without zlib.
+ */
+uki_error uki_ctx_page_compression(uki_ctx_t *ctx, const bool enabled) {
+	if (enabled && !gzip_available())
+		return UKI_ERROR_NO_COMPRESSION;
+
+	page_cache_compress(&ctx->page_cache, enabled);
+	return UKI_OK;
+}
+
+/**
+ * Default context version of uki_ctx_page_compression().
+ */
+uki_error uki_page_compression(const bool enabled) {
+	return uki_ctx_page_compression(&default_ctx, enabled);
+}
+
+/**
+ * Puts a second level to the rendered pages cache in shared memory, so that
+ * every process that maps the same file shares the pages rendered by any of
+ * them. This is meant for servers that fork a number of workers: set it up in
+ * each worker (or once before forking) and keep the per-process budget small.
+ * Pages are only shared between processes that have the same settings loaded.
+ * @remark Only available on UNIX systems.
+ *
+ * @param  ctx  Wiki context.
+ * @param  path Path to the file backing the cache, ideally under /dev/shm, or
+ *              NULL to stop using it. (The file is never deleted)
+ * @param  size Size of the cache in bytes if it has to be created.
+ * @return      UKI_OK or UKI_ERROR_SHARED_CACHE if the cache couldn't be
+ *              mapped.
+ */
+uki_error uki_ctx_shared_page_cache(uki_ctx_t *ctx, const char *path,
+									const size_t size) {
+	shm_cache_t *shared = NULL;
+	shm_cache_t *old;
+
+	// Map the new one.
+	if (path != NULL) {
+		shared = (shm_cache_t*)mem_malloc(sizeof(shm_cache_t));
+		if (!shm_cache_open(shared, path, size)) {
+			mem_free(shared);
+			return UKI_ERROR_SHARED_CACHE;
+		}
+	}
+
+	// Swap it in and unmap the old one once no one is looking at it.
+	mutex_lock(&ctx->lock);
+	old = ctx->shared;
+	sync_store_ptr(&ctx->shared, shared);
+	if (old != NULL)
+		epoch_retire(&ctx->reclaim, old, destroy_shared_cache);
+	mutex_unlock(&ctx->lock);
+
+	return UKI_OK;
+}
+
+/**
+ * Default context version of uki_ctx_shared_page_cache().
+ */
+uki_error uki_shared_page_cache(const char *path, const size_t size) {
+	return uki_ctx_shared_page_cache(&default_ctx, path, size);
+}
+
+/**
+ * Gets a page that isn't in the rendered pages cache from the shared cache or
+ * renders it.
+ * @remark The entry isn't in the cache yet. Hand it to keep_cached_page()
+ *         once no one else can start waiting on it.
+ *
+ * @param  ctx      Wiki context.
+ * @param  entry    Page cache entry with the rendered page.
+ * @param  page     Relative path to the page (without the extension).
+ * @param  settings Settings snapshot the page is for.
+ * @return          UKI_OK if the page was rendered.
+ */
+uki_error fetch_cached_page(uki_ctx_t *ctx, page_cache_entry_t **entry,
+							const char *page, wiki_settings_t *settings) {
+	shm_cache_t *shared;
+	unsigned long fingerprint;
+
+	// Maybe one of the other processes sharing the cache already rendered it.
+	shared = sync_load_ptr(&ctx->shared);
+	fingerprint = settings->fingerprint ^ sync_load(&ctx->page_cache.compress);
+	if ((shared != NULL) && ((*entry = shm_cache_get(shared, &ctx->page_cache,
+			page, fingerprint)) != NULL)) {
+		if ((sync_load(&settings->template_cache.mode) != UKI_CACHE_VALIDATE) ||
+				page_cache_entry_valid(*entry)) {
+			return UKI_OK;
+		}
+
+		shm_cache_remove(shared, page, fingerprint);
+		destroy_page_cache_entry(*entry);
+	}
+
+	return render_cached_page(ctx, entry, page);
+}
+
+/**
+ * Renders a page for the rendered pages cache.
+ * @remark The entry isn't in the cache yet. Hand it to keep_cached_page().
+ *
+ * @param  ctx   Wiki context.
+ * @param  entry Page cache entry with the rendered page.
+ * @param  page  Relative path to the page (without the extension).
+ * @return       UKI_OK if the page was rendered.
+ */
+uki_error render_cached_page(uki_ctx_t *ctx, page_cache_entry_t **entry,
+							 const char *page) {
+	char article_path[UKI_MAX_PATH];
+	char fpath[UKI_MAX_PATH];
+	wiki_settings_t *settings;
+	shm_cache_t *shared;
+	unsigned long compress;
+	uki_page_deps_t deps;
+	uki_error err;
+	size_t i;
+
+	// Build article path.
+	pathcat(3, article_path, ctx->wiki_root, UKI_ARTICLE_ROOT, page);
+	extcat(article_path, UKI_ARTICLE_EXT);
+
+	// Take note of the files the page is rendered from before rendering it.
+	settings = sync_load_ptr(&ctx->settings);
+	compress = sync_load(&ctx->page_cache.compress);
+	*entry = page_cache_entry(&ctx->page_cache, page);
+	page_cache_entry_dep(*entry, article_path);
+	initialize_page_deps(&deps);
+	if (main_template_dependencies(ctx, &deps) == UKI_OK) {
+		for (i = 0; i < deps.ntemplates; i++) {
+			pathcat(3, fpath, ctx->wiki_root, UKI_TEMPLATE_ROOT,
+					deps.templates[i]);
+			extcat(fpath, UKI_TEMPLATE_EXT);
+			page_cache_entry_dep(*entry, fpath);
+		}
+	}
+	free_page_deps(&deps);
+
+	// Render it.
+	if ((err = render_page_entry(ctx, *entry, article_path,
+								 compress)) != UKI_OK) {
+		destroy_page_cache_entry(*entry);
+		*entry = NULL;
+
+		return err;
+	}
+
+	// Share it, as long as the settings didn't change while we were at it.
+	shared = sync_load_ptr(&ctx->shared);
+	if ((shared != NULL) && (settings == sync_load_ptr(&ctx->settings)))
+		shm_cache_put(shared, *entry, settings->fingerprint ^ compress);
+
+	return UKI_OK;
+}
+
+/**
+ * Renders an article file inside the main template into a page cache entry,
+ * along with its compressed version if needed.
+ *
+ * @param  ctx          Wiki context.
+ * @param  entry        Page cache entry to hold the rendered page.
+ * @param  article_path Article page absolute path.
+ * @param  compress     Should the page be compressed as well?
+ * @return              UKI_OK if the page was rendered.
+ */
+uki_error render_page_entry(uki_ctx_t *ctx, page_cache_entry_t *entry,
+							const char *article_path,
+							const unsigned long compress) {
+	uki_error err;
+
+	if ((err = render_page_file(ctx, &entry->data, article_path)) != UKI_OK)
+		return err;
+
+	entry->len = strlen(entry->data);
+	if (compress)
+		gzip_buffer(&entry->gzip, &entry->gzip_len, entry->data, entry->len);
+
+	return UKI_OK;
+}
+
+/**
+ * Puts a rendered page in the cache, if it fits.
+ * @remark Must be called inside a read section, which keeps the entry alive
+ *         even if it doesn't make it into the cache or is evicted right away.
+ *
+ * @param ctx   Wiki context.
+ * @param entry Page cache entry that isn't in the cache yet.
+ */
+void keep_cached_page(uki_ctx_t *ctx, page_cache_entry_t *entry) {
+	// Keep it unless it doesn't fit, in which case it's freed once released.
+	if (!page_cache_insert(&ctx->page_cache, entry))
+		epoch_retire(&ctx->reclaim, entry, destroy_page_cache_entry);
+}
+
+/**
+ * Starts the thread that refreshes the caches in the background, if it isn't
+ * running already.
+ * @remark The context must be locked.
+ *
+ * @param ctx Wiki context.
+ */
+void start_refresher(uki_ctx_t *ctx) {
+	if (ctx->refreshing)
+		return;
+
+#ifdef WINDOWS
+	ctx->refresher = CreateThread(NULL, 0, refresh_worker, ctx, 0, NULL);
+	ctx->refreshing = ctx->refresher != NULL;
+#else
+	ctx->refreshing = pthread_create(&ctx->refresher, NULL, refresh_worker,
+									 ctx) == 0;
+#endif
+}
+
+/**
+ * Stops the thread that refreshes the caches in the background, if it's
+ * running, and waits for it to finish what it's doing.
+ * @remark The context must be locked, or not in use anymore.
+ *
+ * @param ctx Wiki context.
+ */
+void stop_refresher(uki_ctx_t *ctx) {
+	if (!ctx->refreshing)
+		return;
+
+	semaphore_post(&ctx->refresh_wake, 1);
+#ifdef WINDOWS
+	WaitForSingleObject(ctx->refresher, INFINITE);
+	CloseHandle(ctx->refresher);
+#else
+	pthread_join(ctx->refresher, NULL);
+#endif
+	ctx->refreshing = false;
+}
+
+/**
+ * Checks the templates and the cached pages for changes, reloading the
+ * templates and rendering the pages again if they have.
+ *
+ * @param ctx Wiki context.
+ */
+void refresh_caches(uki_ctx_t *ctx) {
+	page_cache_entry_t **entries;
+	page_cache_entry_t *entry;
+	wiki_settings_t *settings;
+	unsigned long pin;
+	size_t n;
+	size_t i;
+
+	// Templates go first so that the pages are rendered with the new ones.
+	pin = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	refresh_template_cache(&settings->template_cache);
+
+	// Replace the pages that have changed, or drop them if they are gone.
+	n = page_cache_entries(&ctx->page_cache, &entries);
+	for (i = 0; i < n; i++) {
+		if (page_cache_entry_valid(entries[i]))
+			continue;
+
+		if (render_cached_page(ctx, &entry, entries[i]->page) == UKI_OK) {
+			keep_cached_page(ctx, entry);
+		} else {
+			page_cache_remove(&ctx->page_cache, entries[i]);
+		}
+	}
+	mem_free(entries);
+	epoch_leave(&ctx->reclaim, pin);
+}
+
+/**
+ * Background cache refresher thread main loop.
+ *
+ * @param  arg Wiki context.
+ * @return     Nothing.
+ */
+#ifdef WINDOWS
+DWORD WINAPI refresh_worker(LPVOID arg) {
+#else
+void* refresh_worker(void *arg) {
+#endif
+	uki_ctx_t *ctx = (uki_ctx_t*)arg;
+
+	// Keep going until we are woken up to stop.
+	while (!semaphore_timedwait(&ctx->refresh_wake,
+								sync_load(&ctx->refresh_interval)))
+		refresh_caches(ctx);
+
+	return 0;
+}
+
+/**
+ * Sets how many threads are used to render batches of pages.
+ *
+ * @param ctx      Wiki context.
+ * @param nworkers Number of threads or 0 to use one per processor.
+ */
+void uki_ctx_batch_workers(uki_ctx_t *ctx, const size_t nworkers) {
+	mutex_lock(&ctx->batch_lock);
+	ctx->nworkers = nworkers;
+
+	// The pool will be started again with the new size on the next batch.
+	if (ctx->pool != NULL) {
+		pool_destroy(ctx->pool);
+		mem_free(ctx->pool);
+		ctx->pool = NULL;
+	}
+	mutex_unlock(&ctx->batch_lock);
+}
+
+/**
+ * Default context version of uki_ctx_batch_workers().
+ */
+void uki_batch_workers(const size_t nworkers) {
+	uki_ctx_batch_workers(&default_ctx, nworkers);
+}
+
+/**
+ * Renders many articles, each inside the main template, spreading them across
+ * the worker threads. Every rendered page is handed to the callback as soon as
+ * it's ready.
+ * @remark The callback is called from the worker threads, so it must be thread
+ *         safe, and it must not start another batch on the same context.
+ *
+ * @param  ctx      Wiki context.
+ * @param  indices  Indices of the articles to be rendered or NULL to render
+ *                  the first n articles.
+ * @param  n        Number of articles to be rendered.
+ * @param  callback Function that gets each of the rendered pages.
+ * @param  user     Pointer passed along to the callback.
+ * @return          UKI_OK if every article was rendered successfully or the
+ *                  error of one of those that failed.
+ */
+uki_error uki_ctx_render_articles_batch(uki_ctx_t *ctx, const size_t *indices,
+										const size_t n,
+										uki_render_callback_t callback,
+										void *user) {
+	batch_job_t job;
+
+	job.ctx = ctx;
+	job.indices = indices;
+	job.pages = NULL;
+	job.callback = callback;
+	job.user = user;
+	job.err = UKI_OK;
+
+	run_in_pool(ctx, render_batch_item, &job, n);
+	return job.err;
+}
+
+/**
+ * Default context version of uki_ctx_render_articles_batch().
+ */
+uki_error uki_render_articles_batch(const size_t *indices, const size_t n,
+									uki_render_callback_t callback,
+									void *user) {
+	return uki_ctx_render_articles_batch(&default_ctx, indices, n, callback,
+										 user);
+}
+
+/**
+ * Gets every template file (including the nested includes) and variable that
+ * goes into rendering a wiki page.
+ *
+ * @param  ctx  Wiki context.
+ * @param  deps Page dependencies. (Free with uki_free_page_dependencies())
+ * @param  page Relative path to the page (without the extension).
+ * @return      UKI_OK if all of the dependencies could be found.
+ */
+uki_error uki_ctx_page_dependencies(uki_ctx_t *ctx, uki_page_deps_t *deps,
+									const char *page) {
+	char article_path[UKI_MAX_PATH];
+	unsigned long token;
+	uki_error err;
+
+	// Build article path.
+	pathcat(3, article_path, ctx->wiki_root, UKI_ARTICLE_ROOT, page);
+	extcat(article_path, UKI_ARTICLE_EXT);
+
+	// Gather the dependencies of the templates and of the article.
+	initialize_page_deps(deps);
+	token = epoch_enter(&ctx->reclaim);
+	err = main_template_dependencies(ctx, deps);
+	epoch_leave(&ctx->reclaim, token);
+	if (err == UKI_OK)
+		err = article_file_dependencies(deps, article_path);
+
+	if (err != UKI_OK)
+		free_page_deps(deps);
+
+	return err;
+}
+
+/**
+ * Default context version of uki_ctx_page_dependencies().
+ */
+uki_error uki_page_dependencies(uki_page_deps_t *deps, const char *page) {
+	return uki_ctx_page_dependencies(&default_ctx, deps, page);
+}
+
+/**
+ * Frees the page dependencies structure.
+ *
+ * @param deps Page dependencies.
+ */
+void uki_free_page_dependencies(uki_page_deps_t *deps) {
+	free_page_deps(deps);
+}
+
+/**
+ * Gets every article whose page depends on a template, either directly or
+ * through a nested include.
+ *
+ * @param  ctx           Wiki context.
+ * @param  indices       Indices of the articles. (Free with uki_free())
+ * @param  n             Number of articles found.
+ * @param  template_name Template name. (Without the extension)
+ * @return               UKI_OK if the dependencies could be worked out.
+ */
+uki_error uki_ctx_dependents_of_template(uki_ctx_t *ctx, size_t **indices,
+										 size_t *n, const char *template_name) {
+	return collect_dependents(ctx, indices, n, template_name, true);
+}
+
+/**
+ * Default context version of uki_ctx_dependents_of_template().
+ */
+uki_error uki_dependents_of_template(size_t **indices, size_t *n,
+									 const char *template_name) {
+	return uki_ctx_dependents_of_template(&default_ctx, indices, n,
+										  template_name);
+}
+
+/**
+ * Gets every article whose page depends on a variable, either through the
+ * templates or the article itself.
+ *
+ * @param  ctx     Wiki context.
+ * @param  indices Indices of the articles. (Free with uki_free())
+ * @param  n       Number of articles found.
+ * @param  key     Variable key.
+ * @return         UKI_OK if the dependencies could be worked out.
+ */
+uki_error uki_ctx_dependents_of_variable(uki_ctx_t *ctx, size_t **indices,
+										 size_t *n, const char *key) {
+	return collect_dependents(ctx, indices, n, key, false);
+}
+
+/**
+ * Default context version of uki_ctx_dependents_of_variable().
+ */
+uki_error uki_dependents_of_variable(size_t **indices, size_t *n,
+									 const char *key) {
+	return uki_ctx_dependents_of_variable(&default_ctx, indices, n, key);
+}
+
+/**
+ * Gathers the dependencies of the main template.
+ * @remark Must be called inside a read section.
+ *
+ * @param  ctx  Wiki context.
+ * @param  deps Page dependencies to add to.
+ * @return      UKI_OK if all of the templates could be found.
+ */
+uki_error main_template_dependencies(uki_ctx_t *ctx, uki_page_deps_t *deps) {
+	wiki_settings_t *settings = sync_load_ptr(&ctx->settings);
+	ssize_t idx;
+
+	if ((idx = find_variable(UKI_VAR_MAIN_TEMPLATE, settings->configs)) < 0)
+		return UKI_ERROR_NOMAINTEMPLATE;
+
+	return template_dependencies(deps, &settings->template_cache,
+								 settings->configs.list[idx].value);
+}
+
+/**
+ * Gathers the variables used by an article file.
+ *
+ * @param  deps         Page dependencies to add to.
+ * @param  article_path Article page absolute path.
+ * @return              UKI_OK if the article could be read.
+ */
+uki_error article_file_dependencies(uki_page_deps_t *deps,
+									const char *article_path) {
+	file_view_t article;
+	uki_error err;
+
+	if (!open_file_view(&article, article_path))
+		return UKI_ERROR_NOARTICLE;
+
+	err = article_dependencies(deps, article.data, article.size);
+	close_file_view(&article);
+
+	return err;
+}
+
+/**
+ * Gets every article whose page depends on a template or variable.
+ *
+ * @param  ctx      Wiki context.
+ * @param  indices  Indices of the articles. (Allocated by this function)
+ * @param  n        Number of articles found.
+ * @param  name     Template name or variable key.
+ * @param  template Are we looking for a template or a variable?
+ * @return          UKI_OK if the dependencies could be worked out.
+ */
+uki_error collect_dependents(uki_ctx_t *ctx, size_t **indices, size_t *n,
+							 const char *name, const bool template) {
+	const uki_article_deps_t *recorded;
+	uki_article_container *articles;
+	wiki_settings_t *settings;
+	char fpath[UKI_MAX_PATH];
+	uki_page_deps_t common;
+	unsigned long token;
+	file_info_t info;
+	uki_error err;
+	bool validate;
+	bool all;
+	size_t i;
+
+	*n = 0;
+	*indices = NULL;
+	token = epoch_enter(&ctx->reclaim);
+	articles = sync_load_ptr(&ctx->articles);
+	settings = sync_load_ptr(&ctx->settings);
+	validate = sync_load(&settings->template_cache.mode) == UKI_CACHE_VALIDATE;
+
+	// Every page goes through the main template, so anything it depends on is
+	// shared by all of them.
+	initialize_page_deps(&common);
+	if ((err = main_template_dependencies(ctx, &common)) != UKI_OK) {
+		free_page_deps(&common);
+		epoch_leave(&ctx->reclaim, token);
+		return err;
+	}
+	all = (template) ? depends_on_template(&common, name) :
+		depends_on_variable(&common, name);
+	free_page_deps(&common);
+
+	// Articles can only use variables, so look into them only if we need to.
+	// Their files are only read again if they changed since we last did it,
+	// and only checked for changes if the cache is validating everything.
+	*indices = (size_t*)mem_malloc(sizeof(size_t) * (articles->size + 1));
+	for (i = 0; i < articles->size; i++) {
+		if (!all) {
+			if (template)
+				continue;
+
+			if (validate) {
+				uki_ctx_article_fpath(ctx, fpath, articles->list[i]);
+				if (!file_info(&info, fpath))
+					continue;
+			}
+
+			recorded = recorded_article_deps(ctx, articles->list[i],
+											 (validate) ? &info : NULL);
+			if ((recorded == NULL) ||
+					!depends_on_variable(&recorded->deps, name)) {
+				continue;
+			}
+		}
+
+		(*indices)[(*n)++] = i;
+	}
+	epoch_leave(&ctx->reclaim, token);
+
+	return UKI_OK;
+}
+
+/**
+ * Gets the variables used by an article from its record, reading them out of
+ * the article file only if they haven't been recorded yet or if the file
+ * changed since they were.
+ * @remark Must be called inside a read section, since that's for as long as
+ *         the returned variables are valid.
+ *
+ * @param  ctx     Wiki context.
+ * @param  article Article to get the variables of.
+ * @param  info    Current metadata of the article file or NULL to trust what
+ *                 was recorded.
+ * @return         Recorded variables or NULL if the article couldn't be read.
+ */
+const uki_article_deps_t* recorded_article_deps(uki_ctx_t *ctx,
+												const uki_article_t article,
+												const file_info_t *info) {
+	uki_article_deps_t *recorded;
+	char fpath[UKI_MAX_PATH];
+
+	// Use what we already know if the file hasn't changed since.
+	recorded = sync_load_ptr(article.deps);
+	if ((recorded != NULL) &&
+			((info == NULL) || !file_info_changed(recorded->info, *info))) {
+		return recorded;
+	}
+
+	// Read the variables out of the article file.
+	uki_ctx_article_fpath(ctx, fpath, article);
+	recorded = (uki_article_deps_t*)mem_malloc(sizeof(uki_article_deps_t));
+	initialize_page_deps(&recorded->deps);
+	if (info != NULL) {
+		recorded->info = *info;
+	} else if (!file_info(&recorded->info, fpath)) {
+		free_article_deps(recorded);
+		return NULL;
+	}
+	if (article_file_dependencies(&recorded->deps, fpath) != UKI_OK) {
+		free_article_deps(recorded);
+		return NULL;
+	}
+
+	// Record them for next time, leaving the old ones to whoever has them.
+	epoch_retire(&ctx->reclaim, sync_swap_ptr(article.deps, recorded),
+				 destroy_article_deps);
+
+	return recorded;
+}
+
+/**
+ * Exports the whole wiki as a static website, rendering every article inside
+ * the main template across the worker threads. The output folder mirrors the
+ * wiki layout, with the pages inside the articles folder next to a copy of the
+ * assets folder, so that the asset paths in the rendered pages still work.
+ * @remark Pages are only rendered again if their article, the templates they
+ *         include, the variables they use or the manifest changed since they
+ *         were last exported. Assets are only copied again if they changed.
+ * @remark What the pages were exported with is kept in the wiki folder, so
+ *         that nothing but the website ends up in the output folder.
+ *
+ * @param  ctx      Wiki context.
+ * @param  out_root Path to the folder where the website will be exported to.
+ * @param  full     Render and copy everything, even if nothing has changed.
+ * @param  stats    Summary of what was done. (Can be NULL)
+ * @return          UKI_OK if everything was exported successfully or the error
+ *                  of one of the pages that failed.
+ */
+uki_error uki_ctx_export(uki_ctx_t *ctx, const char *out_root, const bool full,
+						 uki_export_stats_t *stats) {
+	uki_variable_container exported;
+	wiki_settings_t *settings;
+	uki_page_deps_t common;
+	char fpath[UKI_MAX_PATH];
+	file_info_t newest;
+	export_job_t job;
+	unsigned long token;
+	bool all_stale;
+	bool has_state;
+	size_t nstale;
+	size_t nskipped;
+	size_t i;
+
+	job.ctx = ctx;
+	job.out_root = out_root;
+	job.full = full;
+	job.rendered = 0;
+	job.copied = 0;
+	job.failed = 0;
+	job.err = UKI_OK;
+
+	// Pin down the wiki for the whole export.
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	job.articles = sync_load_ptr(&ctx->articles);
+	job.indices = (size_t*)mem_malloc(sizeof(size_t) *
+									  (job.articles->size + 1));
+
+	// Get the variables the pages were last exported with.
+	export_state_fpath(ctx, fpath, out_root);
+	initialize_variables(&exported);
+	has_state = !full && populate_variables(&exported, fpath);
+
+	// Everything that goes into every page.
+	initialize_page_deps(&common);
+	all_stale = full || (main_template_dependencies(ctx, &common) != UKI_OK) ||
+		variables_changed(&common, exported, settings->variables);
+	newest_dependency(ctx, &common, has_state, &newest);
+
+	// Pick out the pages that are out of date.
+	nstale = 0;
+	for (i = 0; i < job.articles->size; i++) {
+		if (all_stale || export_page_stale(ctx, job.articles->list[i],
+										   out_root, newest, has_state,
+										   exported, settings->variables)) {
+			job.indices[nstale++] = i;
+		}
+	}
+	free_page_deps(&common);
+
+	// Render them.
+	nskipped = job.articles->size - nstale;
+	run_in_pool(ctx, export_article_item, &job, nstale);
+	mem_free(job.indices);
+
+	// Remember which variables the pages were exported with.
+	if (job.err == UKI_OK) {
+		if (!write_variables(fpath, settings->variables))
+			job.err = UKI_ERROR_EXPORT_WRITE;
+	}
+	free_variables(exported);
+	epoch_leave(&ctx->reclaim, token);
+
+	// Copy the assets over.
+	pathcat(2, fpath, ctx->wiki_root, UKI_ASSETS_ROOT);
+	job.assets.size = 0;
+	if (list_directory_files(&job.assets, fpath, true) == UKI_OK) {
+		run_in_pool(ctx, export_asset_item, &job, job.assets.size);
+		free_dirlist(job.assets);
+	}
+
+	// Summarize.
+	if (stats != NULL) {
+		stats->rendered = (size_t)job.rendered;
+		stats->skipped = nskipped;
+		stats->assets = (size_t)job.copied;
+		stats->failed = (size_t)job.failed;
+	}
+
+	return job.err;
+}
+
+/**
+ * Default context version of uki_ctx_export().
+ */
+uki_error uki_export(const char *out_root, const bool full,
+					 uki_export_stats_t *stats) {
+	return uki_ctx_export(&default_ctx, out_root, full, stats);
+}
+
+/**
+ * Renders many wiki pages, spreading them across the worker threads. Every
+ * rendered page is handed to the callback as soon as it's ready.
+ * @remark The callback is called from the worker threads, so it must be thread
+ *         safe, and it must not start another batch on the same context.
+ *
+ * @param  ctx      Wiki context.
+ * @param  pages    Relative paths to the pages (without the extension).
+ * @param  n        Number of pages to be rendered.
+ * @param  callback Function that gets each of the rendered pages.
+ * @param  user     Pointer passed along to the callback.
+ * @return          UKI_OK if every page was rendered successfully or the error
+ *                  of one of those that failed.
+ */
+uki_error uki_ctx_render_pages_batch(uki_ctx_t *ctx, const char **pages,
+									 const size_t n,
+									 uki_render_callback_t callback,
+									 void *user) {
+	batch_job_t job;
+
+	job.ctx = ctx;
+	job.indices = NULL;
+	job.pages = pages;
+	job.callback = callback;
+	job.user = user;
+	job.err = UKI_OK;
+
+	run_in_pool(ctx, render_batch_item, &job, n);
+	return job.err;
+}
+
+/**
+ * Default context version of uki_ctx_render_pages_batch().
+ */
+uki_error uki_render_pages_batch(const char **pages, const size_t n,
+								 uki_render_callback_t callback, void *user) {
+	return uki_ctx_render_pages_batch(&default_ctx, pages, n, callback, user);
+}
+
+/**
+ * Render a wiki page into a caller supplied buffer without allocating any
+ * memory once the templates are cached.
+ * @remark Just like snprintf the page is truncated if it doesn't fit, so the
+ *         caller can grow the buffer to the reported size and try again.
+ *
+ * @param  ctx    Wiki context.
+ * @param  buf    Pre-allocated buffer. (Can be NULL if cap is 0)
+ * @param  cap    Size of the buffer.
+ * @param  needed Size of the buffer needed to hold the whole page including
+ *                the NULL terminator.
+ * @param  page   Relative path to the page (without the extension).
+ * @return        UKI_OK if there were no errors or UKI_ERROR_BUFFER_TOO_SMALL
+ *                if the page didn't fit.
+ */
+uki_error uki_ctx_render_page_into(uki_ctx_t *ctx, char *buf, const size_t cap,
+								   size_t *needed, const char *page) {
+	char article_path[UKI_MAX_PATH];
+	wiki_settings_t *settings;
+	unsigned long token;
+	uki_error err;
+	ssize_t idx;
+
+	// Build article path.
+	*needed = 0;
+	pathcat(3, article_path, ctx->wiki_root, UKI_ARTICLE_ROOT, page);
+	extcat(article_path, UKI_ARTICLE_EXT);
+
+	// Get main template and render the article inside it.
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	if (!article_exists(ctx, article_path)) {
+		err = UKI_ERROR_NOARTICLE;
+	} else if ((idx = find_variable(UKI_VAR_MAIN_TEMPLATE,
+									settings->configs)) < 0) {
+		err = UKI_ERROR_NOMAINTEMPLATE;
+	} else {
+		err = render_page_into(buf, cap, needed, &settings->template_cache,
+							   settings->configs.list[idx].value, article_path,
+							   settings->variables);
+	}
+	epoch_leave(&ctx->reclaim, token);
+
+	return err;
+}
+
+/**
+ * Default context version of uki_ctx_render_page_into().
+ */
+uki_error uki_render_page_into(char *buf, const size_t cap, size_t *needed,
+							   const char *page) {
+	return uki_ctx_render_page_into(&default_ctx, buf, cap, needed, page);
+}
+
+/**
+ * Render a wiki page as a list of segments that can be written out with
+ * writev() without ever being concatenated.
+ * @remark The segments stay valid until uki_ctx_free_page_iov() is called,
+ *         even if the wiki is reloaded in the meantime.
+ *
+ * @param  ctx      Wiki context.
+ * @param  rendered Rendered page segments. (Must always be freed with
+ *                  uki_ctx_free_page_iov())
+ * @param  page     Relative path to the page (without the extension).
+ * @return          UKI_OK if there were no errors.
+ */
+uki_error uki_ctx_render_page_iov(uki_ctx_t *ctx, uki_page_iov_t *rendered,
+								  const char *page) {
+	char article_path[UKI_MAX_PATH];
+	wiki_settings_t *settings;
+	unsigned long token;
+	uki_error err;
+	ssize_t idx = 0;
+
+	// Build article path.
+	pathcat(3, article_path, ctx->wiki_root, UKI_ARTICLE_ROOT, page);
+	extcat(article_path, UKI_ARTICLE_EXT);
+
+	// Get main template and render the article inside it.
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	if (!article_exists(ctx, article_path) ||
+			((idx = find_variable(UKI_VAR_MAIN_TEMPLATE,
+								  settings->configs)) < 0)) {
+		rendered->list = NULL;
+		rendered->size = 0;
+		rendered->capacity = 0;
+		rendered->len = 0;
+		rendered->article.data = NULL;
+		rendered->reclaim = NULL;
+
+		err = (idx < 0) ? UKI_ERROR_NOMAINTEMPLATE : UKI_ERROR_NOARTICLE;
+	} else {
+		err = render_page_iov(rendered, &settings->template_cache,
+							  settings->configs.list[idx].value, article_path,
+							  settings->variables);
+	}
+	epoch_leave(&ctx->reclaim, token);
+
+	return err;
+}
+
+/**
+ * Default context version of uki_ctx_render_page_iov().
+ */
+uki_error uki_render_page_iov(uki_page_iov_t *rendered, const char *page) {
+	return uki_ctx_render_page_iov(&default_ctx, rendered, page);
+}
+
+/**
+ * Frees a wiki page rendered as a list of segments.
+ *
+ * @param ctx      Wiki context.
+ * @param rendered Rendered page segments.
+ */
+void uki_ctx_free_page_iov(uki_ctx_t *ctx, uki_page_iov_t *rendered) {
+	(void)ctx;
+	free_page_iov(rendered);
+}
+
+/**
+ * Default context version of uki_ctx_free_page_iov().
+ */
+void uki_free_page_iov(uki_page_iov_t *rendered) {
+	uki_ctx_free_page_iov(&default_ctx, rendered);
+}
+
+/**
+ * Gets the number of available configurations.
+ *
+ * @param  ctx Wiki context.
+ * @return    Number of available configurations.
+ */
+size_t uki_ctx_configs_available(uki_ctx_t *ctx) {
+	wiki_settings_t *settings;
+	unsigned long token;
+	size_t size;
+
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	size = settings->configs.size;
+	epoch_leave(&ctx->reclaim, token);
+
+	return size;
+}
+
+/**
+ * Default context version of uki_ctx_configs_available().
+ */
+size_t uki_configs_available() {
+	return uki_ctx_configs_available(&default_ctx);
+}
+
+/**
+ * Gets a uki configuration by its index.
+ *
+ * @param  ctx   Wiki context.
+ * @param  index Configuration index.
+ * @return       The variable structure if it was found. NULL otherwise.
+ */
+uki_variable_t uki_ctx_config(uki_ctx_t *ctx, const size_t index) {
+	wiki_settings_t *settings;
+	unsigned long token;
+	uki_variable_t var;
+
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	var = find_variable_i(index, settings->configs);
+	epoch_leave(&ctx->reclaim, token);
+
+	return var;
+}
+
+/**
+ * Default context version of uki_ctx_config().
+ */
+uki_variable_t uki_config(const size_t index) {
+	return uki_ctx_config(&default_ctx, index);
+}
+
+/**
+ * Gets a uki configuration by its key.
+ *
+ * @param  ctx Wiki context.
+ * @param  key Configuration key.
+ * @return     The variable structure if it was found. NULL otherwise.
+ */
+uki_variable_t uki_ctx_find_config(uki_ctx_t *ctx, const char *key) {
+	wiki_settings_t *settings;
+	unsigned long token;
+	uki_variable_t var;
+
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	var = find_variable_i((size_t)find_variable(key, settings->configs),
+						  settings->configs);
+	epoch_leave(&ctx->reclaim, token);
+
+	return var;
+}
+
+/**
+ * Default context version of uki_ctx_find_config().
+ */
+uki_variable_t uki_find_config(const char *key) {
+	return uki_ctx_find_config(&default_ctx, key);
+}
+
+/**
+ * Gets the number of available variables.
+ *
+ * @param  ctx Wiki context.
+ * @return    Number of available variables.
+ */
+size_t uki_ctx_variables_available(uki_ctx_t *ctx) {
+	wiki_settings_t *settings;
+	unsigned long token;
+	size_t size;
+
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	size = settings->variables.size;
+	epoch_leave(&ctx->reclaim, token);
+
+	return size;
+}
+
+/**
+ * Default context version of uki_ctx_variables_available().
+ */
+size_t uki_variables_available() {
+	return uki_ctx_variables_available(&default_ctx);
+}
+
+/**
+ * Gets a uki variable by its index.
+ *
+ * @param  ctx   Wiki context.
+ * @param  index Variable index.
+ * @return       The variable structure if it was found. NULL otherwise.
+ */
+uki_variable_t uki_ctx_variable(uki_ctx_t *ctx, const size_t index) {
+	wiki_settings_t *settings;
+	unsigned long token;
+	uki_variable_t var;
+
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	var = find_variable_i(index, settings->variables);
+	epoch_leave(&ctx->reclaim, token);
+
+	return var;
+}
+
+/**
+ * Default context version of uki_ctx_variable().
+ */
+uki_variable_t uki_variable(const size_t index) {
+	return uki_ctx_variable(&default_ctx, index);
+}
+
+/**
+ * Gets a uki variable by its key.
+ *
+ * @param  ctx Wiki context.
+ * @param  key Variable key.
+ * @return     The variable structure if it was found. NULL otherwise.
+ */
+uki_variable_t uki_ctx_find_variable(uki_ctx_t *ctx, const char *key) {
+	wiki_settings_t *settings;
+	unsigned long token;
+	uki_variable_t var;
+
+	token = epoch_enter(&ctx->reclaim);
+	settings = sync_load_ptr(&ctx->settings);
+	var = find_variable_i((size_t)find_variable(key, settings->variables),
+						  settings->variables);
+	epoch_leave(&ctx->reclaim, token);
+
+	return var;
+}
+
+/**
+ * Default context version of uki_ctx_find_variable().
+ */
+uki_variable_t uki_find_variable(const char *key) {
+	return uki_ctx_find_variable(&default_ctx, key);
+}
+
+/**
+ * Gets the number of available articles.
+ *
+ * @param  ctx Wiki context.
+ * @return    Number of available articles.
+ */
+size_t uki_ctx_articles_available(uki_ctx_t *ctx) {
+	uki_article_container *articles;
+	unsigned long token;
+	size_t size;
+
+	token = epoch_enter(&ctx->reclaim);
+	articles = sync_load_ptr(&ctx->articles);
+	size = articles->size;
+	epoch_leave(&ctx->reclaim, token);
+
+	return size;
+}
+
+/**
+ * Default context version of uki_ctx_articles_available().
+ */
+size_t uki_articles_available() {
+	return uki_ctx_articles_available(&default_ctx);
+}
+
+/**
+ * Gets a uki article structure by its index.
+ *
+ * @param  ctx   Wiki context.
+ * @param  index Article index.
+ * @param        The article structure if it was found. NULL otherwise.
+ */
+uki_article_t uki_ctx_article(uki_ctx_t *ctx, const size_t index) {
+	uki_article_container *articles;
+	unsigned long token;
+	uki_article_t article;
+
+	token = epoch_enter(&ctx->reclaim);
+	articles = sync_load_ptr(&ctx->articles);
+	article = find_article_i(index, *articles);
+	epoch_leave(&ctx->reclaim, token);
+
+	return article;
+}
+
+/**
+ * Default context version of uki_ctx_article().
+ */
+uki_article_t uki_article(const size_t index) {
+	return uki_ctx_article(&default_ctx, index);
+}
+
+/**
+ * Add a new article. Readers that are going through the articles at the same
+ * time keep seeing the list they started with.
+ *
+ * @param  ctx          Wiki context.
+ * @param  article_path Complete path to the article file.
+ * @return              Recently added article.
+ */
+uki_article_t uki_ctx_add_article(uki_ctx_t *ctx, const char *article_path) {
+	uki_article_container *articles;
+	uki_article_container *old;
+	uki_article_t article;
+
+	// Add the article to a copy of the container and swap it in.
+	mutex_lock(&ctx->lock);
+	old = ctx->articles;
+	articles = (uki_article_container*)mem_malloc(
+		sizeof(uki_article_container));
+	clone_articles(articles, old);
+	article = add_article(articles, article_path, NULL);
+	sync_store_ptr(&ctx->articles, articles);
+	epoch_retire(&ctx->reclaim, old, destroy_article_list);
+	mutex_unlock(&ctx->lock);
+
+	return article;
+}
+
+/**
+ * Default context version of uki_ctx_add_article().
+ */
+uki_article_t uki_add_article(const char *article_path) {
+	return uki_ctx_add_article(&default_ctx, article_path);
+}
+
+/**
+ * Gets the number of available templates.
  *
- * @param  rendered Rendered page contents (Allocated by this fuction).
- * @param  index    Article index.
- * @param  preview  Is this for preview? (Will change the contents of the page)
- * @return          UKI_OK if the operation was successful.
+ * @param  ctx Wiki context.
+ * @return    Number of available templates.
  */
-uki_error uki_render_article(char **rendered, const size_t index,
-							 const bool preview) {
-	uki_article_t article;
-	char fpath[UKI_MAX_PATH];
-	uki_error err;
-
-	// Get the article.
-	article = uki_article(index);
-	if (article.name == NULL)
-		return UKI_ERROR_INDEX_NOT_FOUND;
-
-	// Get the file path.
-	if ((err = uki_article_fpath(fpath, article)) != UKI_OK)
-		return err;
-
-	// Check if there is an article there.
-	if (!file_exists(fpath))
-		return UKI_ERROR_NOARTICLE;
+size_t uki_ctx_templates_available(uki_ctx_t *ctx) {
+	uki_template_container *templates;
+	unsigned long token;
+	size_t size;
 
-	// Slurp file.
-	slurp_file(rendered, fpath);
-	if (rendered == NULL)
-		return UKI_ERROR_PARSING_ARTICLE;
+	token = epoch_enter(&ctx->reclaim);
+	templates = sync_load_ptr(&ctx->templates);
+	size = templates->size;
+	epoch_leave(&ctx->reclaim, token);
 
-	// Substitute asset paths if we are in preview mode.
-	if (preview)
-		return uki_render_article_from_text(rendered, article.deepness);
+	return size;
+}
 
-	return UKI_OK;
+/**
+ * Default context version of uki_ctx_templates_available().
+ */
+size_t uki_templates_available() {
+	return uki_ctx_templates_available(&default_ctx);
 }
 
 /**
- * Render a wiki page.
+ * Gets a uki template structure by its index.
  *
- * @param  rendered Rendered page text (will be allocated by this function).
- * @param  page     Relative path to the page (without the extension).
- * @return          UKI_OK if there were no errors.
+ * @param  ctx   Wiki context.
+ * @param  index Template index.
+ * @param        The template structure if it was found. NULL otherwise.
  */
-uki_error uki_render_page(char **rendered, const char *page) {
-	char article_path[UKI_MAX_PATH];
-	uki_error err;
-
-	// Get main template.
-	int idx = find_variable(UKI_VAR_MAIN_TEMPLATE, configs);
-	if (idx < 0)
-		return UKI_ERROR_NOMAINTEMPLATE;
+uki_template_t uki_ctx_template(uki_ctx_t *ctx, const size_t index) {
+	uki_template_container *templates;
+	unsigned long token;
+	uki_template_t template;
 
-	// Render template for placing article into.
-	if ((err = render_template(rendered, configs.list[idx].value)) != UKI_OK)
-		return err;
+	token = epoch_enter(&ctx->reclaim);
+	templates = sync_load_ptr(&ctx->templates);
+	template = find_template_i(index, *templates);
+	epoch_leave(&ctx->reclaim, token);
 
-	// Build article path and render it.
-	pathcat(3, article_path, wiki_root, UKI_ARTICLE_ROOT, page);
-	extcat(article_path, UKI_ARTICLE_EXT);
-	if ((err = render_article_in_template(rendered, article_path)) != UKI_OK)
-		return err;
+	return template;
+}
 
-	return render_variables(rendered, variables);
+/**
+ * Default context version of uki_ctx_template().
+ */
+uki_template_t uki_template(const size_t index) {
+	return uki_ctx_template(&default_ctx, index);
 }
 
 /**
- * Gets the number of available configurations.
+ * Add a new template. Readers that are going through the templates at the
+ * same time keep seeing the list they started with.
  *
- * @return Number of available configurations.
+ * @param  ctx           Wiki context.
+ * @param  template_path Complete path to the template file.
+ * @return               Recently added template.
  */
-size_t uki_configs_available() {
-	return configs.size;
+uki_template_t uki_ctx_add_template(uki_ctx_t *ctx, const char *template_path) {
+	uki_template_container *templates;
+	uki_template_container *old;
+	uki_template_t template;
+
+	// Add the template to a copy of the container and swap it in.
+	mutex_lock(&ctx->lock);
+	old = ctx->templates;
+	templates = (uki_template_container*)mem_malloc(
+		sizeof(uki_template_container));
+	clone_templates(templates, old);
+	template = add_template(templates, template_path, NULL);
+	sync_store_ptr(&ctx->templates, templates);
+	epoch_retire(&ctx->reclaim, old, destroy_template_list);
+	mutex_unlock(&ctx->lock);
+
+	return template;
 }
 
 /**
- * Gets a uki configuration by its index.
- *
- * @param  index Configuration index.
- * @return       The variable structure if it was found. NULL otherwise.
+ * Default context version of uki_ctx_add_template().
  */
-uki_variable_t uki_config(const uint8_t index) {
-	return find_variable_i(index, configs);
+uki_template_t uki_add_template(const char *template_path) {
+	return uki_ctx_add_template(&default_ctx, template_path);
 }
 
 /**
- * Gets the number of available variables.
+ * Sets how the compiled templates and rendered pages caches should check for
+ * changes. In the background mode lookups never touch the filesystem: a thread
+ * checks the files every so often (see uki_ctx_refresh_interval()) and swaps
+ * in new versions of whatever changed, while renders keep getting the old ones
+ * until the new ones are ready.
  *
- * @return Number of available variables.
+ * @param ctx  Wiki context.
+ * @param mode UKI_CACHE_VALIDATE to check the files for changes before every
+ *             render, UKI_CACHE_FROZEN to never check them once they have
+ *             been loaded or UKI_CACHE_BACKGROUND to check them in the
+ *             background.
  */
-size_t uki_variables_available() {
-	return variables.size;
+void uki_ctx_template_cache_mode(uki_ctx_t *ctx, const uint8_t mode) {
+	mutex_lock(&ctx->lock);
+	ctx->cache_mode = mode;
+	sync_store(&ctx->settings->template_cache.mode, mode);
+	if (mode == UKI_CACHE_BACKGROUND) {
+		start_refresher(ctx);
+	} else {
+		stop_refresher(ctx);
+	}
+	mutex_unlock(&ctx->lock);
 }
 
 /**
- * Gets a uki variable by its index.
- *
- * @param  index Variable index.
- * @return       The variable structure if it was found. NULL otherwise.
+ * Default context version of uki_ctx_template_cache_mode().
  */
-uki_variable_t uki_variable(const uint8_t index) {
-	return find_variable_i(index, variables);
+void uki_template_cache_mode(const uint8_t mode) {
+	uki_ctx_template_cache_mode(&default_ctx, mode);
 }
 
 /**
- * Gets the number of available articles.
+ * Sets how often the caches are checked for changes in the background mode.
  *
- * @return Number of available articles.
+ * @param ctx      Wiki context.
+ * @param interval Time between checks in milliseconds.
  */
-size_t uki_articles_available() {
-	return articles.size;
+void uki_ctx_refresh_interval(uki_ctx_t *ctx, const unsigned long interval) {
+	sync_store(&ctx->refresh_interval, interval);
 }
 
 /**
- * Gets a uki article structure by its index.
- *
- * @param  index Article index.
- * @param        The article structure if it was found. NULL otherwise.
+ * Default context version of uki_ctx_refresh_interval().
  */
-uki_article_t uki_article(const size_t index) {
-	return find_article_i(index, articles);
+void uki_refresh_interval(const unsigned long interval) {
+	uki_ctx_refresh_interval(&default_ctx, interval);
 }
 
 /**
- * Add a new article.
+ * Enables or disables the pre-rendered page skeleton. When enabled the main
+ * template is expanded only once, with all of its includes and variables, and
+ * rendering a page becomes just a matter of placing the article in it.
  *
- * @param  article_path Complete path to the article file.
- * @return              Recently added article.
+ * @param ctx     Wiki context.
+ * @param enabled Should the page skeleton be used?
  */
-uki_article_t uki_add_article(const char *article_path) {
-	return add_article(&articles, article_path);
+void uki_ctx_skeleton_mode(uki_ctx_t *ctx, const bool enabled) {
+	mutex_lock(&ctx->lock);
+	ctx->skeleton_enabled = enabled;
+	sync_store(&ctx->settings->template_cache.skeleton_enabled, enabled);
+	if (!enabled)
+		free_page_skeleton(&ctx->settings->template_cache);
+	mutex_unlock(&ctx->lock);
 }
 
 /**
- * Gets the number of available templates.
- *
- * @return Number of available templates.
+ * Default context version of uki_ctx_skeleton_mode().
  */
-size_t uki_templates_available() {
-	return templates.size;
+void uki_skeleton_mode(const bool enabled) {
+	uki_ctx_skeleton_mode(&default_ctx, enabled);
 }
 
 /**
- * Gets a uki template structure by its index.
+ * Throws away all the compiled templates, forcing them to be read from disk
+ * again the next time they are needed. Renders that are still using them
+ * aren't affected.
  *
- * @param  index Template index.
- * @param        The template structure if it was found. NULL otherwise.
+ * @param ctx Wiki context.
  */
-uki_template_t uki_template(const size_t index) {
-	return find_template_i(index, templates);
+void uki_ctx_flush_template_cache(uki_ctx_t *ctx) {
+	mutex_lock(&ctx->lock);
+	flush_template_cache(&ctx->settings->template_cache);
+	mutex_unlock(&ctx->lock);
 }
 
 /**
- * Add a new template.
- *
- * @param  template_path Complete path to the template file.
- * @return               Recently added template.
+ * Default context version of uki_ctx_flush_template_cache().
  */
-uki_template_t uki_add_template(const char *template_path) {
-	return add_template(&templates, template_path);
+void uki_flush_template_cache() {
+	uki_ctx_flush_template_cache(&default_ctx);
 }
 
 /**
  * Creates a file path to an article.
  *
+ * @param  ctx     Wiki context.
  * @param  fpath   Pre-allocated string buffer to store the article file path.
  * @param  article Article structure.
  * @return         UKI_OK if the operation was successful.
  */
-uki_error uki_article_fpath(char *fpath, const uki_article_t article) {
+uki_error uki_ctx_article_fpath(uki_ctx_t *ctx, char *fpath,
+								const uki_article_t article) {
 	// Build article path.
-	pathcat(3, fpath, wiki_root, UKI_ARTICLE_ROOT, article.path);
+	pathcat(3, fpath, ctx->wiki_root, UKI_ARTICLE_ROOT, article.path);
 	return UKI_OK;
 }
 
+/**
+ * Default context version of uki_ctx_article_fpath().
+ */
+uki_error uki_article_fpath(char *fpath, const uki_article_t article) {
+	return uki_ctx_article_fpath(&default_ctx, fpath, article);
+}
+
 /**
  * Creates a file path to a template.
  *
+ * @param  ctx      Wiki context.
  * @param  fpath    Pre-allocated string buffer to store the template file path.
  * @param  template Template structure.
  * @return          UKI_OK if the operation was successful.
  */
-uki_error uki_template_fpath(char *fpath, const uki_template_t template) {
+uki_error uki_ctx_template_fpath(uki_ctx_t *ctx, char *fpath,
+								 const uki_template_t template) {
 	// Build template path.
-	pathcat(3, fpath, wiki_root, UKI_TEMPLATE_ROOT, template.path);
+	pathcat(3, fpath, ctx->wiki_root, UKI_TEMPLATE_ROOT, template.path);
 	return UKI_OK;
 }
 
+/**
+ * Default context version of uki_ctx_template_fpath().
+ */
+uki_error uki_template_fpath(char *fpath, const uki_template_t template) {
+	return uki_ctx_template_fpath(&default_ctx, fpath, template);
+}
+
 /**
  * Gets the path to the articles folder.
  *
+ * @param  ctx   Wiki context.
  * @param  fpath Pre-allocated string buffer to store the articles folder path.
  * @return       UKI_OK if the operation was successful.
  */
-uki_error uki_folder_articles(char *fpath) {
+uki_error uki_ctx_folder_articles(uki_ctx_t *ctx, char *fpath) {
 	// Build article path.
-	pathcat(2, fpath, wiki_root, UKI_ARTICLE_ROOT);
+	pathcat(2, fpath, ctx->wiki_root, UKI_ARTICLE_ROOT);
 	return UKI_OK;
 }
 
+/**
+ * Default context version of uki_ctx_folder_articles().
+ */
+uki_error uki_folder_articles(char *fpath) {
+	return uki_ctx_folder_articles(&default_ctx, fpath);
+}
+
 /**
  * Gets the path to the templates folder.
  *
+ * @param  ctx   Wiki context.
  * @param  fpath Pre-allocated string buffer to store the templates folder path.
  * @return       UKI_OK if the operation was successful.
  */
-uki_error uki_folder_templates(char *fpath) {
+uki_error uki_ctx_folder_templates(uki_ctx_t *ctx, char *fpath) {
 	// Build template path.
-	pathcat(2, fpath, wiki_root, UKI_TEMPLATE_ROOT);
+	pathcat(2, fpath, ctx->wiki_root, UKI_TEMPLATE_ROOT);
 	return UKI_OK;
 }
 
+/**
+ * Default context version of uki_ctx_folder_templates().
+ */
+uki_error uki_folder_templates(char *fpath) {
+	return uki_ctx_folder_templates(&default_ctx, fpath);
+}
+
 /**
  * Gets a error message beased on a error code from uki.
  *
@@ -363,6 +2338,14 @@ const char* uki_error_msg(const uki_error ecode) {
 		return "String conversion from Unicode to ASCII failed\n";
 	case UKI_ERROR_REGEX_ASSET_IMAGE:
 		return "There was a regex failure while substituting image assets.\n";
+	case UKI_ERROR_BUFFER_TOO_SMALL:
+		return "The supplied buffer is too small for the rendered contents.\n";
+	case UKI_ERROR_EXPORT_WRITE:
+		return "Couldn't write a file to the export folder.\n";
+	case UKI_ERROR_NO_COMPRESSION:
+		return "The library was built without support for compression.\n";
+	case UKI_ERROR_SHARED_CACHE:
+		return "Couldn't map the shared rendered pages cache.\n";
 	case UKI_ERROR:
 		return "General error.\n";
 	}
@@ -374,13 +2357,178 @@ const char* uki_error_msg(const uki_error ecode) {
  * Clean up our mess.
  */
 void uki_clean() {
-	if (uki_initialized) {
-		free(wiki_root);
-		free_variables(configs);
-		free_variables(variables);
-		free_articles(articles);
-		free_templates(templates);
+	clean_context(&default_ctx);
+
+	// Give back the memory held for rendering in this thread.
+	render_arena_release();
+}
+
+/**
+ * Frees everything held by a context and leaves it ready to be initialized
+ * again.
+ *
+ * @param ctx Wiki context.
+ */
+void clean_context(uki_ctx_t *ctx) {
+	if (!ctx->initialized)
+		return;
+
+	// Stop the workers before pulling the wiki out from under them.
+	stop_refresher(ctx);
+	if (ctx->pool != NULL) {
+		pool_destroy(ctx->pool);
+		mem_free(ctx->pool);
+	}
+
+	mem_free(ctx->wiki_root);
+	destroy_settings(ctx->settings);
+	destroy_articles(ctx->articles);
+	destroy_templates(ctx->templates);
+	page_cache_destroy(&ctx->page_cache);
+	destroy_shared_cache(ctx->shared);
+	epoch_destroy(&ctx->reclaim);
+	semaphore_destroy(&ctx->refresh_wake);
+	mutex_destroy(&ctx->batch_lock);
+	mutex_destroy(&ctx->lock);
+	memset(ctx, 0, sizeof(uki_ctx_t));
+}
+
+/**
+ * Frees a settings snapshot.
+ *
+ * @param settings Settings snapshot. (Can be NULL)
+ */
+void destroy_settings(void *settings) {
+	wiki_settings_t *set = (wiki_settings_t*)settings;
+
+	if (set == NULL)
+		return;
+
+	free_variables(set->configs);
+	free_variables(set->variables);
+	free_template_cache(&set->template_cache);
+	mem_free(set);
+}
+
+/**
+ * Sums up everything a page's looks depend on, other than the files it's
+ * rendered from, so that processes can tell if they'd render it the same way.
+ *
+ * @param  wiki_root Path to the root of the wiki.
+ * @param  settings  Settings snapshot with the variables populated.
+ * @return           Fingerprint of the settings.
+ */
+unsigned long settings_fingerprint(const char *wiki_root,
+								   const wiki_settings_t *settings) {
+	unsigned long hash;
+	size_t i;
+
+	// The root is thrown in so that different wikis never share pages.
+	hash = strhash(wiki_root);
+	for (i = 0; i < settings->configs.size; i++) {
+		hash = (hash ^ strhash(settings->configs.list[i].key)) * 16777619UL;
+		hash = (hash ^ strhash(settings->configs.list[i].value)) * 16777619UL;
+	}
+	hash = (hash ^ settings->configs.size) * 16777619UL;
+	for (i = 0; i < settings->variables.size; i++) {
+		hash = (hash ^ strhash(settings->variables.list[i].key)) * 16777619UL;
+		hash = (hash ^ strhash(settings->variables.list[i].value)) * 16777619UL;
 	}
+
+	// Leave the lowest bit for telling compressed pages apart.
+	return hash & ~1UL;
+}
+
+/**
+ * Gets how many threads should go through the wiki folders when loading it,
+ * as set in the manifest.
+ *
+ * @param  settings Settings snapshot with the configurations populated.
+ * @return          Number of threads. 1 if the folders should be scanned
+ *                  serially.
+ */
+size_t scan_threads(const wiki_settings_t *settings) {
+	ssize_t idx;
+	long nthreads;
+
+	// Scan serially unless asked not to, since local disks don't need it.
+	if ((idx = find_variable(UKI_VAR_SCAN_THREADS, settings->configs)) < 0)
+		return 1;
+
+	// Zero means one per processor.
+	nthreads = strtol(settings->configs.list[idx].value, NULL, 10);
+	if (nthreads == 0)
+		return cpu_count();
+
+	return (nthreads > 0) ? (size_t)nthreads : 1;
+}
+
+/**
+ * Unmaps and frees a shared rendered pages cache handle.
+ *
+ * @param shared Shared cache handle. (Can be NULL)
+ */
+void destroy_shared_cache(void *shared) {
+	if (shared == NULL)
+		return;
+
+	shm_cache_close((shm_cache_t*)shared);
+	mem_free(shared);
+}
+
+/**
+ * Frees an articles container along with all of its articles.
+ *
+ * @param articles Articles container. (Can be NULL)
+ */
+void destroy_articles(void *articles) {
+	if (articles == NULL)
+		return;
+
+	free_articles(*(uki_article_container*)articles);
+	mem_free(articles);
+}
+
+/**
+ * Frees an articles container that shares its articles with a newer one.
+ *
+ * @param articles Articles container.
+ */
+void destroy_article_list(void *articles) {
+	release_articles(*(uki_article_container*)articles);
+	mem_free(articles);
+}
+
+/**
+ * Frees the variables that were recorded for an article.
+ *
+ * @param deps Recorded article variables. (Can be NULL)
+ */
+void destroy_article_deps(void *deps) {
+	free_article_deps((uki_article_deps_t*)deps);
+}
+
+/**
+ * Frees a templates container along with all of its templates.
+ *
+ * @param templates Templates container. (Can be NULL)
+ */
+void destroy_templates(void *templates) {
+	if (templates == NULL)
+		return;
+
+	free_templates(*(uki_template_container*)templates);
+	mem_free(templates);
+}
+
+/**
+ * Frees a templates container that shares its templates with a newer one.
+ *
+ * @param templates Templates container.
+ */
+void destroy_template_list(void *templates) {
+	release_templates(*(uki_template_container*)templates);
+	mem_free(templates);
 }
 
 /**
@@ -392,26 +2540,320 @@ void uki_clean() {
  * @return           UKI_OK if the operation was successful. Respective error
  *                   code otherwise.
  */
-uki_error populate_variable_container(const char *wiki_root, const char *var_fname,
-								uki_variable_container *container) {
+uki_error populate_variable_container(const char *wiki_root,
+									  const char *var_fname,
+									  uki_variable_container *container) {
 	// Get path string length and allocate some memory.
 	size_t path_len = strlen(wiki_root) + strlen(var_fname) + 2;
-	char *var_path = (char*)malloc(path_len * sizeof(char));
+	char *var_path = (char*)mem_malloc(path_len * sizeof(char));
 
 	// Build the wiki variables file path and check for its existance.
 	pathcat(2, var_path, wiki_root, var_fname);
 	if (!file_exists(var_path)) {
-		free(var_path);
+		mem_free(var_path);
 		return UKI_ERROR_NOVARIABLES;
 	}
 
 	// Initialize and populate variable container.
 	initialize_variables(container);
 	if (!populate_variables(container, var_path)) {
-		free(var_path);
+		mem_free(var_path);
 		return UKI_ERROR_PARSING_VARIABLES;
 	}
 
-	free(var_path);
+	mem_free(var_path);
 	return UKI_OK;
 }
+
+/**
+ * Runs a job in the worker pool, starting it if needed.
+ * @remark Jobs on the same context are run one at a time.
+ *
+ * @param ctx  Wiki context.
+ * @param task Task to be run for each item of the job.
+ * @param job  Job passed along to the task.
+ * @param n    Number of items in the job.
+ */
+void run_in_pool(uki_ctx_t *ctx, pool_task_t task, void *job, const size_t n) {
+	size_t nworkers;
+
+	mutex_lock(&ctx->batch_lock);
+	if (ctx->pool == NULL) {
+		// The calling thread also works on the batch, so it counts as one.
+		nworkers = (ctx->nworkers > 0) ? ctx->nworkers : cpu_count();
+		ctx->pool = (pool_t*)mem_malloc(sizeof(pool_t));
+		pool_init(ctx->pool, nworkers - 1);
+	}
+
+	pool_run(ctx->pool, task, job, n);
+	mutex_unlock(&ctx->batch_lock);
+}
+
+/**
+ * Renders a single item of a batch and hands it to the callback.
+ *
+ * @param job  Batch rendering job.
+ * @param item Index of the item in the batch.
+ */
+void render_batch_item(void *job, const size_t item) {
+	batch_job_t *batch = (batch_job_t*)job;
+	char *rendered = NULL;
+	uki_error err;
+
+	// Render the page.
+	if (batch->pages != NULL) {
+		err = uki_ctx_render_page(batch->ctx, &rendered, batch->pages[item]);
+	} else {
+		err = render_article_page(batch->ctx, &rendered,
+								  (batch->indices != NULL) ?
+								  batch->indices[item] : item);
+	}
+
+	// Deliver it and clean up.
+	batch->callback(batch->user, item, err, (err == UKI_OK) ? rendered : NULL);
+	if (err != UKI_OK)
+		sync_store(&batch->err, err);
+	uki_free(rendered);
+}
+
+/**
+ * Builds the path to the file holding the variables the pages of a static
+ * export were last rendered with. Each output folder gets its own file inside
+ * the wiki folder.
+ *
+ * @param ctx      Wiki context.
+ * @param fpath    Path to the export state file.
+ * @param out_root Path to the folder where the website is exported to.
+ */
+void export_state_fpath(uki_ctx_t *ctx, char *fpath, const char *out_root) {
+	char fname[32];
+
+	sprintf(fname, UKI_EXPORT_STATE, strhash(out_root));
+	pathcat(2, fpath, ctx->wiki_root, fname);
+}
+
+/**
+ * Gets the modification time of the newest file, other than the article
+ * itself, that goes into rendering every page.
+ *
+ * @param ctx       Wiki context.
+ * @param common    Dependencies shared by every page.
+ * @param has_state Do we know which variables the pages were exported with?
+ * @param newest    File metadata structure with the newest modification time.
+ */
+void newest_dependency(uki_ctx_t *ctx, const uki_page_deps_t *common,
+					   const bool has_state, file_info_t *newest) {
+	char fpath[UKI_MAX_PATH];
+	file_info_t info;
+	size_t i;
+
+	newest->size = 0;
+	newest->mtime = 0;
+	newest->mtime_nsec = 0;
+	newest->inode = 0;
+
+	// Wiki settings. (Variables are checked one by one if we can)
+	pathcat(2, fpath, ctx->wiki_root, UKI_MANIFEST_PATH);
+	if (file_info(&info, fpath) && file_info_newer(info, *newest))
+		*newest = info;
+	pathcat(2, fpath, ctx->wiki_root, UKI_VARIABLE_PATH);
+	if (!has_state && file_info(&info, fpath) && file_info_newer(info, *newest))
+		*newest = info;
+
+	// Templates.
+	for (i = 0; i < common->ntemplates; i++) {
+		pathcat(3, fpath, ctx->wiki_root, UKI_TEMPLATE_ROOT,
+				common->templates[i]);
+		extcat(fpath, UKI_TEMPLATE_EXT);
+		if (file_info(&info, fpath) && file_info_newer(info, *newest))
+			*newest = info;
+	}
+}
+
+/**
+ * Checks if an exported page is out of date.
+ * @remark Must be called inside a read section.
+ *
+ * @param  ctx       Wiki context.
+ * @param  article   Article of the page.
+ * @param  out_root  Path to the folder where the website is exported to.
+ * @param  newest    Newest file every page depends on.
+ * @param  has_state Do we know which variables the pages were exported with?
+ * @param  exported  Variables the pages were last exported with.
+ * @param  current   Variables the pages will be exported with.
+ * @return           TRUE if the page must be rendered again.
+ */
+bool export_page_stale(uki_ctx_t *ctx, const uki_article_t article,
+					   const char *out_root, const file_info_t newest,
+					   const bool has_state,
+					   const uki_variable_container exported,
+					   const uki_variable_container current) {
+	char fpath[UKI_MAX_PATH];
+	char out_path[UKI_MAX_PATH];
+	const uki_article_deps_t *recorded;
+	file_info_t src_info;
+	file_info_t out_info;
+
+	// Check the files themselves.
+	uki_ctx_article_fpath(ctx, fpath, article);
+	pathcat(3, out_path, out_root, UKI_ARTICLE_ROOT, article.path);
+	if (!file_info(&out_info, out_path) || !file_info(&src_info, fpath) ||
+			file_info_newer(src_info, out_info) ||
+			file_info_newer(newest, out_info))
+		return true;
+
+	// Make sure the compressed copy is there if it's wanted.
+	if (sync_load(&ctx->page_cache.compress)) {
+		extcat(out_path, UKI_GZIP_EXT);
+		if (!file_exists(out_path))
+			return true;
+	}
+
+	// Check the variables used by the article.
+	if (!has_state)
+		return false;
+	recorded = recorded_article_deps(ctx, article, &src_info);
+
+	return (recorded == NULL) ||
+		variables_changed(&recorded->deps, exported, current);
+}
+
+/**
+ * Checks if any of the variables a page depends on has changed.
+ *
+ * @param  deps     Page dependencies.
+ * @param  previous Variables the page was rendered with.
+ * @param  current  Variables the page would be rendered with now.
+ * @return          TRUE if any of the variables was changed, added or removed.
+ */
+bool variables_changed(const uki_page_deps_t *deps,
+					   const uki_variable_container previous,
+					   const uki_variable_container current) {
+	ssize_t iprev;
+	ssize_t icur;
+	size_t i;
+
+	for (i = 0; i < deps->nvariables; i++) {
+		iprev = find_variable(deps->variables[i], previous);
+		icur = find_variable(deps->variables[i], current);
+
+		if ((iprev < 0) != (icur < 0))
+			return true;
+		if ((iprev >= 0) && (strcmp(previous.list[iprev].value,
+									current.list[icur].value) != 0))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Writes a variables container to a file that can be read back with
+ * populate_variables().
+ *
+ * @param  fname     File path.
+ * @param  variables Variables container.
+ * @return           TRUE if the file was written successfully.
+ */
+bool write_variables(const char *fname,
+					 const uki_variable_container variables) {
+	strbuf_t buf;
+	bool ok;
+	size_t i;
+
+	strbuf_init(&buf, 256);
+	for (i = 0; i < variables.size; i++) {
+		strbuf_appends(&buf, variables.list[i].key);
+		strbuf_append(&buf, "=", 1);
+		strbuf_appends(&buf, variables.list[i].value);
+		strbuf_append(&buf, "\n", 1);
+	}
+
+	ok = create_parent_dirs(fname) && write_file(fname, buf.str, buf.len);
+	strbuf_free(&buf);
+
+	return ok;
+}
+
+/**
+ * Renders a single page of a static export and writes it out.
+ *
+ * @param job  Static export job.
+ * @param item Index of the item in the list of pages to be rendered.
+ */
+void export_article_item(void *job, const size_t item) {
+	export_job_t *export = (export_job_t*)job;
+	uki_article_t article = export->articles->list[export->indices[item]];
+	char fpath[UKI_MAX_PATH];
+	char *rendered = NULL;
+	uki_error err;
+
+	// Render the page with the asset paths pointing to the exported assets.
+	uki_ctx_article_fpath(export->ctx, fpath, article);
+	err = render_page_file(export->ctx, &rendered, fpath);
+	if (err == UKI_OK)
+		err = substitute_assets(&rendered, article.deepness);
+
+	// Write it out.
+	if (err == UKI_OK) {
+		pathcat(3, fpath, export->out_root, UKI_ARTICLE_ROOT, article.path);
+		if (!create_parent_dirs(fpath) ||
+				!write_file(fpath, rendered, strlen(rendered)))
+			err = UKI_ERROR_EXPORT_WRITE;
+	}
+
+	// Along with a compressed copy of it.
+	if ((err == UKI_OK) && sync_load(&export->ctx->page_cache.compress)) {
+		char *gzip;
+		size_t gzip_len;
+
+		extcat(fpath, UKI_GZIP_EXT);
+		if (!gzip_buffer(&gzip, &gzip_len, rendered, strlen(rendered)) ||
+				!write_file(fpath, gzip, gzip_len))
+			err = UKI_ERROR_EXPORT_WRITE;
+		mem_free(gzip);
+	}
+	uki_free(rendered);
+
+	// Keep count.
+	if (err == UKI_OK) {
+		sync_add(&export->rendered, 1);
+	} else {
+		sync_add(&export->failed, 1);
+		sync_store(&export->err, err);
+	}
+}
+
+/**
+ * Copies a single asset of a static export if it has changed.
+ *
+ * @param job  Static export job.
+ * @param item Index of the asset in the listing.
+ */
+void export_asset_item(void *job, const size_t item) {
+	export_job_t *export = (export_job_t*)job;
+	const char *src = export->assets.list[item];
+	const file_info_t src_info = export->assets.info[item];
+	char assets_root[UKI_MAX_PATH];
+	char dest[UKI_MAX_PATH];
+	file_info_t dest_info;
+
+	// Build the destination path.
+	pathcat(2, assets_root, export->ctx->wiki_root, UKI_ASSETS_ROOT);
+	pathcat(3, dest, export->out_root, UKI_ASSETS_ROOT,
+			src + strlen(assets_root));
+
+	// Skip the ones that haven't changed. (The listing has the source's info)
+	if (!export->full && file_info(&dest_info, dest) &&
+			(src_info.size == dest_info.size) &&
+			!file_info_newer(src_info, dest_info))
+		return;
+
+	// Copy it over.
+	if (create_parent_dirs(dest) && copy_file(dest, src)) {
+		sync_add(&export->copied, 1);
+	} else {
+		sync_add(&export->failed, 1);
+		sync_store(&export->err, UKI_ERROR_EXPORT_WRITE);
+	}
+}
@@ -10,6 +10,7 @@
 
 #include "windowshelper.h"
 #include "constants.h"
+#include "allocator.h"
 #include "config.h"
 #include "template.h"
 #include "article.h"
@@ -25,28 +26,102 @@
 #define DLL_API extern
 #endif
 
+// Wiki context handle.
+typedef struct uki_ctx_s uki_ctx_t;
+
+// Batch rendering callback. (Rendered is NULL if err isn't UKI_OK and is only
+// valid until the callback returns)
+typedef void (*uki_render_callback_t)(void *user, const size_t item,
+									  const uki_error err,
+									  const char *rendered);
+
+// Shared read-only rendered page.
+typedef struct {
+	const char *data;
+	size_t len;
+	const char *gzip;
+	size_t gzip_len;
+	epoch_domain_t *reclaim;
+	unsigned long pin;
+} uki_page_ref_t;
+
+// Static export summary.
+typedef struct {
+	size_t rendered;
+	size_t skipped;
+	size_t assets;
+	size_t failed;
+} uki_export_stats_t;
+
 // Error handling.
 DLL_API const char* uki_error_msg(const int ecode);
 
 // Initialization and destruction.
+DLL_API uki_error uki_open(uki_ctx_t **ctx, const char *wiki_path);
+DLL_API void uki_close(uki_ctx_t *ctx);
 DLL_API uki_error uki_initialize(const char *wiki_path);
 DLL_API void uki_clean();
+DLL_API uki_error uki_ctx_reload(uki_ctx_t *ctx);
+DLL_API uki_error uki_reload();
+
+// Concurrency.
+DLL_API unsigned long uki_ctx_read_begin(uki_ctx_t *ctx);
+DLL_API void uki_ctx_read_end(uki_ctx_t *ctx, const unsigned long token);
+DLL_API unsigned long uki_read_begin();
+DLL_API void uki_read_end(const unsigned long token);
+
+// Memory management.
+DLL_API void uki_set_allocator(const uki_allocator_t *allocator);
+DLL_API void uki_free(void *ptr);
 
 // Lookup.
+DLL_API size_t uki_ctx_configs_available(uki_ctx_t *ctx);
+DLL_API size_t uki_ctx_variables_available(uki_ctx_t *ctx);
+DLL_API size_t uki_ctx_articles_available(uki_ctx_t *ctx);
+DLL_API size_t uki_ctx_templates_available(uki_ctx_t *ctx);
+DLL_API uki_variable_t uki_ctx_config(uki_ctx_t *ctx, const size_t index);
+DLL_API uki_variable_t uki_ctx_variable(uki_ctx_t *ctx, const size_t index);
+DLL_API uki_variable_t uki_ctx_find_config(uki_ctx_t *ctx, const char *key);
+DLL_API uki_variable_t uki_ctx_find_variable(uki_ctx_t *ctx, const char *key);
+DLL_API uki_article_t uki_ctx_article(uki_ctx_t *ctx, const size_t index);
+DLL_API uki_template_t uki_ctx_template(uki_ctx_t *ctx, const size_t index);
 DLL_API size_t uki_configs_available();
 DLL_API size_t uki_variables_available();
 DLL_API size_t uki_articles_available();
 DLL_API size_t uki_templates_available();
-DLL_API uki_variable_t uki_config(const uint8_t index);
-DLL_API uki_variable_t uki_variable(const uint8_t index);
+DLL_API uki_variable_t uki_config(const size_t index);
+DLL_API uki_variable_t uki_variable(const size_t index);
+DLL_API uki_variable_t uki_find_config(const char *key);
+DLL_API uki_variable_t uki_find_variable(const char *key);
 DLL_API uki_article_t uki_article(const size_t index);
 DLL_API uki_template_t uki_template(const size_t index);
 
 // Asset management.
+DLL_API uki_article_t uki_ctx_add_article(uki_ctx_t *ctx,
+										  const char *article_path);
+DLL_API uki_template_t uki_ctx_add_template(uki_ctx_t *ctx,
+											const char *template_path);
 DLL_API uki_article_t uki_add_article(const char *article_path);
 DLL_API uki_template_t uki_add_template(const char *template_path);
 
+// Caching.
+DLL_API void uki_ctx_template_cache_mode(uki_ctx_t *ctx, const uint8_t mode);
+DLL_API void uki_ctx_refresh_interval(uki_ctx_t *ctx,
+									  const unsigned long interval);
+DLL_API void uki_ctx_skeleton_mode(uki_ctx_t *ctx, const bool enabled);
+DLL_API void uki_ctx_flush_template_cache(uki_ctx_t *ctx);
+DLL_API void uki_template_cache_mode(const uint8_t mode);
+DLL_API void uki_refresh_interval(const unsigned long interval);
+DLL_API void uki_skeleton_mode(const bool enabled);
+DLL_API void uki_flush_template_cache();
+
 // Paths.
+DLL_API uki_error uki_ctx_article_fpath(uki_ctx_t *ctx, char *fpath,
+										const uki_article_t article);
+DLL_API uki_error uki_ctx_template_fpath(uki_ctx_t *ctx, char *fpath,
+										 const uki_template_t template);
+DLL_API uki_error uki_ctx_folder_articles(uki_ctx_t *ctx, char *fpath);
+DLL_API uki_error uki_ctx_folder_templates(uki_ctx_t *ctx, char *fpath);
 DLL_API uki_error uki_article_fpath(char *fpath, const uki_article_t article);
 DLL_API uki_error uki_template_fpath(char *fpath, const uki_template_t template);
 DLL_API uki_error uki_folder_articles(char *fpath);
@@ -55,10 +130,96 @@ DLL_API uki_error uki_folder_templates(char *fpath);
 // Rendering.
 DLL_API uki_error uki_render_template_from_text(char **content, const int deepness);
 DLL_API uki_error uki_render_article_from_text(char **content, const int deepness);
+DLL_API uki_error uki_ctx_render_article(uki_ctx_t *ctx, char **rendered,
+										 const size_t index,
+										 const bool preview);
+DLL_API uki_error uki_ctx_render_article_into(uki_ctx_t *ctx, char *buf,
+											  const size_t cap, size_t *needed,
+											  const size_t index,
+											  const bool preview);
+DLL_API uki_error uki_ctx_render_page(uki_ctx_t *ctx, char **rendered,
+									  const char *page);
+DLL_API uki_error uki_ctx_render_page_into(uki_ctx_t *ctx, char *buf,
+										   const size_t cap, size_t *needed,
+										   const char *page);
+DLL_API uki_error uki_ctx_render_page_iov(uki_ctx_t *ctx,
+										  uki_page_iov_t *rendered,
+										  const char *page);
+DLL_API void uki_ctx_free_page_iov(uki_ctx_t *ctx, uki_page_iov_t *rendered);
 DLL_API uki_error uki_render_article(char **rendered, const size_t index,
 									 const bool preview);
+DLL_API uki_error uki_render_article_into(char *buf, const size_t cap,
+										  size_t *needed, const size_t index,
+										  const bool preview);
 DLL_API uki_error uki_render_template(char **rendered, const size_t index,
 									  const bool preview);
 DLL_API uki_error uki_render_page(char **rendered, const char *page);
+DLL_API uki_error uki_render_page_into(char *buf, const size_t cap,
+									   size_t *needed, const char *page);
+DLL_API uki_error uki_render_page_iov(uki_page_iov_t *rendered,
+									  const char *page);
+DLL_API void uki_free_page_iov(uki_page_iov_t *rendered);
+
+// Rendered pages cache.
+DLL_API uki_error uki_ctx_render_page_cached(uki_ctx_t *ctx,
+											 uki_page_ref_t *rendered,
+											 const char *page);
+DLL_API void uki_ctx_release_page(uki_ctx_t *ctx, uki_page_ref_t *rendered);
+DLL_API void uki_ctx_page_cache_budget(uki_ctx_t *ctx, const size_t budget);
+DLL_API void uki_ctx_flush_page_cache(uki_ctx_t *ctx);
+DLL_API uki_error uki_ctx_page_compression(uki_ctx_t *ctx, const bool enabled);
+DLL_API uki_error uki_ctx_shared_page_cache(uki_ctx_t *ctx, const char *path,
+											const size_t size);
+DLL_API uki_error uki_render_page_cached(uki_page_ref_t *rendered,
+										 const char *page);
+DLL_API void uki_release_page(uki_page_ref_t *rendered);
+DLL_API void uki_page_cache_budget(const size_t budget);
+DLL_API void uki_flush_page_cache();
+DLL_API uki_error uki_page_compression(const bool enabled);
+DLL_API uki_error uki_shared_page_cache(const char *path, const size_t size);
+
+// Batch rendering.
+DLL_API void uki_ctx_batch_workers(uki_ctx_t *ctx, const size_t nworkers);
+DLL_API uki_error uki_ctx_render_articles_batch(uki_ctx_t *ctx,
+												const size_t *indices,
+												const size_t n,
+												uki_render_callback_t callback,
+												void *user);
+DLL_API uki_error uki_ctx_render_pages_batch(uki_ctx_t *ctx, const char **pages,
+											 const size_t n,
+											 uki_render_callback_t callback,
+											 void *user);
+DLL_API void uki_batch_workers(const size_t nworkers);
+DLL_API uki_error uki_render_articles_batch(const size_t *indices,
+											const size_t n,
+											uki_render_callback_t callback,
+											void *user);
+DLL_API uki_error uki_render_pages_batch(const char **pages, const size_t n,
+										 uki_render_callback_t callback,
+										 void *user);
+
+// Dependencies.
+DLL_API uki_error uki_ctx_page_dependencies(uki_ctx_t *ctx,
+											uki_page_deps_t *deps,
+											const char *page);
+DLL_API uki_error uki_ctx_dependents_of_template(uki_ctx_t *ctx,
+												 size_t **indices, size_t *n,
+												 const char *template_name);
+DLL_API uki_error uki_ctx_dependents_of_variable(uki_ctx_t *ctx,
+												 size_t **indices, size_t *n,
+												 const char *key);
+DLL_API uki_error uki_page_dependencies(uki_page_deps_t *deps,
+										const char *page);
+DLL_API uki_error uki_dependents_of_template(size_t **indices, size_t *n,
+											 const char *template_name);
+DLL_API uki_error uki_dependents_of_variable(size_t **indices, size_t *n,
+											 const char *key);
+DLL_API void uki_free_page_dependencies(uki_page_deps_t *deps);
+
+// Static export.
+DLL_API uki_error uki_ctx_export(uki_ctx_t *ctx, const char *out_root,
+								 const bool full, uki_export_stats_t *stats);
+DLL_API uki_error uki_export(const char *out_root, const bool full,
+							 uki_export_stats_t *stats);
 
 #endif /* _UKI_H_ */